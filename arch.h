@@ -24,6 +24,22 @@
                             } while(0)
 */
 
+// thread local storage, host port: every thread can run its own scheduler instance
+#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L)
+#define ARCH_THREAD_LOCAL _Thread_local
+#else
+#define ARCH_THREAD_LOCAL
+#endif
+
+// busy wait hint, host port: spin loops give the pipeline (and the other hyperthread) a break
+#if defined(__x86_64__) || defined(__i386__)
+#define arch_cpu_relax() __builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define arch_cpu_relax() __asm__ __volatile__("yield")
+#else
+#define arch_cpu_relax()
+#endif
+
 /* - typedef ---------------------------------------------------------------- */
 
 /* - public functions ------------------------------------------------------- */
@@ -0,0 +1,176 @@
+/**
+ * Martin Egli
+ * 2024-10-16
+ * typed bounded channels between tasks, built on fifo_t
+ * coop scheduler for mcu
+ */
+
+// - includes ------------------------------------------------------------------
+#include <string.h>
+#include "channel.h"
+#include "arch.h"
+
+// - private functions ---------------------------------------------------------
+static inline uint16_t channel_count_inline(channel_t *ch) {
+    // values are at (rd, wr]
+    if(ch->fifo.wr >= ch->fifo.rd) {
+        return ch->fifo.wr - ch->fifo.rd;
+    }
+    return ch->fifo.size - ch->fifo.rd + ch->fifo.wr;
+}
+
+/**
+ * register a sender that found the channel full, once
+ * @param   tid     task identifier of the sender, =0: not called from a task
+ * @return  =true: OK, registered or not called from a task
+ *          =false: error, all waiter slots are taken
+ */
+static int8_t channel_add_waiter(channel_t *ch, uint8_t tid) {
+    uint8_t n, free = CHANNEL_NB_OF_WAITERS;
+    if(tid == 0) {
+        return true;
+    }
+    for(n = 0; n < CHANNEL_NB_OF_WAITERS; n++) {
+        if(ch->waiter[n] == tid) {
+            // already waiting
+            return true;
+        }
+        if((ch->waiter[n] == 0) && (free == CHANNEL_NB_OF_WAITERS)) {
+            free = n;
+        }
+    }
+    if(free == CHANNEL_NB_OF_WAITERS) {
+        return false;
+    }
+    ch->waiter[free] = tid;
+    return true;
+}
+
+// - public functions ----------------------------------------------------------
+int8_t channel_ctx_init(scheduler_ctx_t *ctx, channel_t *ch, void *data, uint16_t item_size, uint16_t size,
+    uint8_t rx_tid, uint8_t readable_event, uint8_t writable_event) {
+    if((ctx == NULL) || (ch == NULL) || (data == NULL) || (item_size == 0) || (size < 2)) {
+        // error, invalid arguments
+        return false;
+    }
+    if(EVENT_DATA_FITS(ch) == false) {
+        // error, the events carry the channel, its address does not fit (EVENTS_COMPACT on 64 bit hosts)
+        return false;
+    }
+    fifo_init(&ch->fifo, data, size);
+    ch->item_size = item_size;
+    ch->rx_tid = rx_tid;
+    ch->readable_event = readable_event;
+    ch->writable_event = writable_event;
+    ch->flags = 0;
+    memset(ch->waiter, 0, sizeof(ch->waiter));
+    ch->sched = ctx;
+    return true;
+}
+
+int8_t channel_send(channel_t *ch, const void *value) {
+    uint16_t sr;
+    uint8_t notify;
+    int8_t ret;
+
+    if((ch == NULL) || (value == NULL)) {
+        return false;
+    }
+    lock_interrupt(sr);
+    if(fifo_try_append(&ch->fifo) == false) {
+        // full, wake up this sender when there is space again
+        ret = channel_add_waiter(ch, scheduler_ctx_get_current_tid(ch->sched)) ? false : CHANNEL_FULL_NO_WAITER;
+        restore_interrupt(sr);
+        return ret;
+    }
+    memcpy((uint8_t *)ch->fifo.data + (uint32_t)ch->fifo.wr_proc * ch->item_size, value, ch->item_size);
+    fifo_finalize_append(&ch->fifo);
+    // 1 readable event per burst
+    notify = ((ch->flags & CHANNEL_FLAG_READABLE) == 0);
+    ch->flags |= CHANNEL_FLAG_READABLE;
+    restore_interrupt(sr);
+    if(notify) {
+        if(scheduler_ctx_send_event(ch->sched, ch->rx_tid, ch->readable_event, ch) == false) {
+            // main_fifo is full, the value stays in the channel, try again with the next send
+            ch->flags &= ~CHANNEL_FLAG_READABLE;
+        }
+    }
+    return true;
+}
+
+uint16_t channel_receive(channel_t *ch, void *values, uint16_t max) {
+    uint8_t waiter[CHANNEL_NB_OF_WAITERS];
+    uint16_t sr, n, first, part;
+    uint8_t notify, k;
+
+    if((ch == NULL) || (values == NULL)) {
+        return 0;
+    }
+    lock_interrupt(sr);
+    // the readable event is received (or not needed)
+    ch->flags &= ~CHANNEL_FLAG_READABLE;
+    n = channel_count_inline(ch);
+    if(n > max) {
+        n = max;
+    }
+    if(n) {
+        // copy in bulk, up to the end of the ring, then from its start
+        first = fifo_next_pos(ch->fifo.rd, ch->fifo.size);
+        part = ch->fifo.size - first;
+        if(part > n) {
+            part = n;
+        }
+        memcpy(values, (uint8_t *)ch->fifo.data + (uint32_t)first * ch->item_size, (uint32_t)part * ch->item_size);
+        memcpy((uint8_t *)values + (uint32_t)part * ch->item_size, ch->fifo.data, (uint32_t)(n - part) * ch->item_size);
+        ch->fifo.rd += n;
+        if(ch->fifo.rd >= ch->fifo.size) {
+            ch->fifo.rd -= ch->fifo.size;
+        }
+    }
+    // values left (max was too small): the receiver gets another readable event
+    notify = (channel_count_inline(ch) != 0);
+    if(notify) {
+        ch->flags |= CHANNEL_FLAG_READABLE;
+    }
+    memcpy(waiter, ch->waiter, sizeof(waiter));
+    if(n) {
+        memset(ch->waiter, 0, sizeof(ch->waiter));
+    }
+    restore_interrupt(sr);
+    if(notify && (scheduler_ctx_send_event(ch->sched, ch->rx_tid, ch->readable_event, ch) == false)) {
+        ch->flags &= ~CHANNEL_FLAG_READABLE;
+    }
+    if(n) {
+        // there is space again, wake up the waiting senders
+        for(k = 0; k < CHANNEL_NB_OF_WAITERS; k++) {
+            if(waiter[k]) {
+                scheduler_ctx_send_event(ch->sched, waiter[k], ch->writable_event, ch);
+            }
+        }
+    }
+    return n;
+}
+
+uint16_t channel_count(channel_t *ch) {
+    uint16_t sr, n;
+    if(ch == NULL) {
+        return 0;
+    }
+    lock_interrupt(sr);
+    n = channel_count_inline(ch);
+    restore_interrupt(sr);
+    return n;
+}
+
+uint16_t channel_space(channel_t *ch) {
+    if(ch == NULL) {
+        return 0;
+    }
+    return ch->fifo.size - 1 - channel_count(ch);
+}
+
+// - default instance ----------------------------------------------------------
+int8_t channel_init(channel_t *ch, void *data, uint16_t item_size, uint16_t size,
+    uint8_t rx_tid, uint8_t readable_event, uint8_t writable_event) {
+    return channel_ctx_init(scheduler_get_ctx(), ch, data, item_size, size, rx_tid, readable_event, writable_event);
+}
@@ -0,0 +1,137 @@
+/**
+ * Martin Egli
+ * 2024-10-16
+ * typed bounded channels between tasks, built on fifo_t
+ * a sender copies the value into the ring of the channel, the receiving task
+ * gets at most 1 "readable" event per burst and drains the channel in bulk,
+ * a sender that found the channel full gets a "writable" event when there is
+ * space again
+ * coop scheduler for mcu
+ */
+
+#ifndef _MM_CHANNEL_H_
+#define _MM_CHANNEL_H_
+
+//- includes -------------------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+#include "fifo.h"
+#include "scheduler.h"
+
+//- defines --------------------------------------------------------------------
+#define CHANNEL_NB_OF_WAITERS (4)   /// senders waiting for space per channel
+// channel_send() result
+#define CHANNEL_FULL_NO_WAITER (-1) /// the channel is full and all waiter slots are taken
+
+//- typedefs -------------------------------------------------------------------
+typedef struct {
+    fifo_t fifo;            /// .data: the values, 1 slot stays unused
+    uint16_t item_size;     /// size of 1 value in bytes
+    uint8_t rx_tid;         /// receiving task
+    uint8_t readable_event; /// sent to rx_tid, data: pointer to the channel, see channel_init()
+    uint8_t writable_event; /// sent to waiting senders, data: as readable_event
+    uint8_t flags;
+    uint8_t waiter[CHANNEL_NB_OF_WAITERS];  /// tids of senders waiting for space, =0: free
+    scheduler_ctx_t *sched;
+} channel_t;
+// .flags
+#define CHANNEL_FLAG_READABLE (1<<0) /// the readable event is sent and not yet received
+
+//- macros ---------------------------------------------------------------------
+/**
+ * define a channel and the storage for nb values of type, initialize it with
+ * CHANNEL_INIT()/CHANNEL_CTX_INIT(), they take the storage from the definition
+ * use: CHANNEL_DEFINE(adc_ch, adc_sample_t, 8); ... CHANNEL_INIT(adc_ch, rx_tid, readable_event, writable_event)
+ */
+#define CHANNEL_DEFINE(name, type, nb) \
+    static type name##_data[(nb) + 1]; \
+    static channel_t name
+
+#define CHANNEL_INIT(name, rx_tid, readable_event, writable_event) \
+    channel_init(&(name), name##_data, sizeof(name##_data[0]), sizeof(name##_data) / sizeof(name##_data[0]), \
+        (rx_tid), (readable_event), (writable_event))
+
+#define CHANNEL_CTX_INIT(ctx, name, rx_tid, readable_event, writable_event) \
+    channel_ctx_init((ctx), &(name), name##_data, sizeof(name##_data[0]), sizeof(name##_data) / sizeof(name##_data[0]), \
+        (rx_tid), (readable_event), (writable_event))
+
+/**
+ * typed send and receive functions for a channel of type,
+ * use: CHANNEL_TYPED(adc_ch, adc_sample_t) gives adc_ch_send(ch, &sample), adc_ch_receive(ch, samples, max)
+ * a channel with another item_size is refused: send returns false, receive 0
+ */
+#define CHANNEL_TYPED(prefix, type) \
+    static inline int8_t prefix##_send(channel_t *ch, const type *value) { \
+        if((ch != NULL) && (ch->item_size != sizeof(type))) { \
+            return false; \
+        } \
+        return channel_send(ch, value); \
+    } \
+    static inline uint16_t prefix##_receive(channel_t *ch, type *values, uint16_t max) { \
+        if((ch != NULL) && (ch->item_size != sizeof(type))) { \
+            return 0; \
+        } \
+        return channel_receive(ch, values, max); \
+    }
+
+// - public functions ----------------------------------------------------------
+
+/**
+ * initialize a channel, it belongs to the scheduler instance that runs in the
+ * calling thread, see scheduler_get_ctx()
+ * @param   ch          channel to initialize
+ * @param   data        storage for size values
+ * @param   item_size   size of 1 value in bytes
+ * @param   size        number of values in data, the channel holds size - 1 values
+ * @param   rx_tid      receiving task
+ * @param   readable_event  event to the receiving task, if the channel got values
+ * @param   writable_event  event to a waiting sender, if the channel has space again
+ * @return  =true: OK, =false: error, invalid arguments or the address of ch
+ *          does not fit into the event data (EVENTS_COMPACT on 64 bit hosts)
+ */
+int8_t channel_init(channel_t *ch, void *data, uint16_t item_size, uint16_t size,
+    uint8_t rx_tid, uint8_t readable_event, uint8_t writable_event);
+
+/**
+ * send a value, copies it into the channel
+ * the receiving task gets the readable event if it is not yet pending
+ * if the channel is full the sending task (if called from a task) is
+ * registered and gets the writable event when there is space again
+ * @param   ch      channel
+ * @param   value   pointer to the value, item_size bytes
+ * @return  =true: OK, value is in the channel
+ *          =false: error, the channel is full (backpressure)
+ *          =CHANNEL_FULL_NO_WAITER: error, the channel is full and the sender
+ *           could not be registered, it gets no writable event, try again later
+ */
+int8_t channel_send(channel_t *ch, const void *value);
+
+/**
+ * receive values, call from the receiving task on the readable event
+ * a readable event can find the channel empty, if the values were already received
+ * @param   ch      channel
+ * @param   values  array to copy the values to
+ * @param   max     number of values to receive at most
+ * @return  number of received values
+ */
+uint16_t channel_receive(channel_t *ch, void *values, uint16_t max);
+
+/**
+ * get the number of values in a channel
+ * @param   ch      channel
+ * @return  number of values
+ */
+uint16_t channel_count(channel_t *ch);
+
+/**
+ * get the free space of a channel
+ * @param   ch      channel
+ * @return  number of values that can be sent
+ */
+uint16_t channel_space(channel_t *ch);
+
+// - scheduler instances -------------------------------------------------------
+int8_t channel_ctx_init(scheduler_ctx_t *ctx, channel_t *ch, void *data, uint16_t item_size, uint16_t size,
+    uint8_t rx_tid, uint8_t readable_event, uint8_t writable_event);
+
+#endif // _MM_CHANNEL_H_
@@ -0,0 +1,103 @@
+/**
+ * Martin Egli
+ * 2024-10-15
+ * deferred binary logging, lock-free ring (multi producer, single consumer)
+ * coop scheduler for mcu
+ */
+
+// - includes ------------------------------------------------------------------
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "dlog.h"
+#include "events.h"
+
+// - private variables ---------------------------------------------------------
+// seq of a record counts relative to its index n in the ring, so a zeroed ring
+// is valid without init: =pos - n: free for position pos, =pos - n + 1: written
+static dlog_record_t dlog_ring[DLOG_RING_SIZE];
+static _Atomic uint16_t dlog_wr;    // runs freely, position = wr & (DLOG_RING_SIZE - 1)
+static uint16_t dlog_rd;            // read by the consumer only
+static atomic_uint dlog_dropped;
+
+static const char dlog_level_char[] = {'-', 'E', 'W', 'I', 'D'};
+
+// - public functions ----------------------------------------------------------
+void dlog_write(uint8_t level, const char *fmt, uint64_t a0, uint64_t a1, uint64_t a2) {
+    dlog_record_t *r;
+    uint16_t pos, n;
+    int16_t diff;
+
+    pos = atomic_load_explicit(&dlog_wr, memory_order_relaxed);
+    while(1) {
+        n = pos & (DLOG_RING_SIZE - 1);
+        r = &dlog_ring[n];
+        diff = (int16_t)(atomic_load_explicit(&r->seq, memory_order_acquire) - (uint16_t)(pos - n));
+        if(diff == 0) {
+            // record is free, claim it
+            if(atomic_compare_exchange_weak_explicit(&dlog_wr, &pos, (uint16_t)(pos + 1),
+                    memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if(diff < 0) {
+            // not yet read, the ring is full
+            atomic_fetch_add_explicit(&dlog_dropped, 1, memory_order_relaxed);
+            return;
+        }
+        else {
+            pos = atomic_load_explicit(&dlog_wr, memory_order_relaxed);
+        }
+    }
+    r->level = level;
+    r->fmt = fmt;
+    r->ticks = events_get_time_ticks();
+    r->arg[0] = a0;
+    r->arg[1] = a1;
+    r->arg[2] = a2;
+    atomic_store_explicit(&r->seq, (uint16_t)(pos - n + 1), memory_order_release);
+}
+
+uint8_t dlog_read(dlog_record_t *rec) {
+    dlog_record_t *r;
+    uint16_t n;
+
+    n = dlog_rd & (DLOG_RING_SIZE - 1);
+    r = &dlog_ring[n];
+    if(atomic_load_explicit(&r->seq, memory_order_acquire) != (uint16_t)(dlog_rd - n + 1)) {
+        // no more records
+        return false;
+    }
+    if(rec != NULL) {
+        rec->level = r->level;
+        rec->fmt = r->fmt;
+        rec->ticks = r->ticks;
+        rec->arg[0] = r->arg[0];
+        rec->arg[1] = r->arg[1];
+        rec->arg[2] = r->arg[2];
+    }
+    // free the record for the next round of the ring
+    atomic_store_explicit(&r->seq, (uint16_t)(dlog_rd - n + DLOG_RING_SIZE), memory_order_release);
+    dlog_rd++;
+    return true;
+}
+
+uint16_t dlog_flush(uint16_t max) {
+    dlog_record_t rec;
+    uint16_t cnt;
+
+    for(cnt = 0; cnt < max; cnt++) {
+        if(dlog_read(&rec) == false) {
+            break;
+        }
+        printf("[%llu] %c: ", (unsigned long long)rec.ticks,
+            dlog_level_char[(rec.level <= DLOG_LEVEL_DEBUG) ? rec.level : 0]);
+        printf(rec.fmt, (unsigned long long)rec.arg[0], (unsigned long long)rec.arg[1], (unsigned long long)rec.arg[2]);
+    }
+    return cnt;
+}
+
+uint32_t dlog_get_dropped(void) {
+    return atomic_load(&dlog_dropped);
+}
@@ -0,0 +1,106 @@
+/**
+ * Martin Egli
+ * 2024-10-15
+ * deferred binary logging: a call site records its format string and up to
+ * DLOG_NB_OF_ARGS raw arguments into a lock-free ring, the text is formatted
+ * later, in idle time (dlog_flush()) or offline from the raw records (dlog_read())
+ * coop scheduler for mcu
+ */
+
+#ifndef _DLOG_H_
+#define _DLOG_H_
+
+//- includes -------------------------------------------------------------------
+#include <stdint.h>
+#include <stdatomic.h>
+
+//- defines --------------------------------------------------------------------
+// log levels, select at compile time with -DDLOG_LEVEL=..., calls above it are removed
+#define DLOG_LEVEL_OFF   (0)
+#define DLOG_LEVEL_ERROR (1)
+#define DLOG_LEVEL_WARN  (2)
+#define DLOG_LEVEL_INFO  (3)
+#define DLOG_LEVEL_DEBUG (4)
+#ifndef DLOG_LEVEL
+#define DLOG_LEVEL DLOG_LEVEL_INFO
+#endif
+#ifndef DLOG_RING_SIZE
+#define DLOG_RING_SIZE (64)     /// number of records, must be a power of 2
+#endif
+#define DLOG_NB_OF_ARGS (3)
+#define DLOG_FLUSH_MAX (8)      /// records formatted per idle pass (1 per busy pass), see scheduler_run()
+
+//- typedefs -------------------------------------------------------------------
+/**
+ * 1 log record, the arguments are stored raw as 64 bit values, so the format
+ * string must use 64 bit conversions: %llu, %lld, %llx
+ */
+typedef struct {
+    _Atomic uint16_t seq;   // written by the ring only
+    uint8_t level;
+    const char *fmt;        /// format string, its address is the id (resolve with the symbols of the ELF file)
+    uint64_t ticks;         /// time of the record, see events_get_time_ticks()
+    uint64_t arg[DLOG_NB_OF_ARGS];
+} dlog_record_t;
+
+//- macros ---------------------------------------------------------------------
+// DLOG_INFO("tid: %llu, event: %llu\n", tid, event); at most DLOG_NB_OF_ARGS arguments
+#define DLOG_ARGS(fmt, a0, a1, a2, ...) fmt, (uint64_t)(a0), (uint64_t)(a1), (uint64_t)(a2)
+
+#if DLOG_LEVEL >= DLOG_LEVEL_ERROR
+#define DLOG_ERROR(...) dlog_write(DLOG_LEVEL_ERROR, DLOG_ARGS(__VA_ARGS__, 0, 0, 0, 0))
+#else
+#define DLOG_ERROR(...)
+#endif
+#if DLOG_LEVEL >= DLOG_LEVEL_WARN
+#define DLOG_WARN(...)  dlog_write(DLOG_LEVEL_WARN, DLOG_ARGS(__VA_ARGS__, 0, 0, 0, 0))
+#else
+#define DLOG_WARN(...)
+#endif
+#if DLOG_LEVEL >= DLOG_LEVEL_INFO
+#define DLOG_INFO(...)  dlog_write(DLOG_LEVEL_INFO, DLOG_ARGS(__VA_ARGS__, 0, 0, 0, 0))
+#else
+#define DLOG_INFO(...)
+#endif
+#if DLOG_LEVEL >= DLOG_LEVEL_DEBUG
+#define DLOG_DEBUG(...) dlog_write(DLOG_LEVEL_DEBUG, DLOG_ARGS(__VA_ARGS__, 0, 0, 0, 0))
+#else
+#define DLOG_DEBUG(...)
+#endif
+
+// - public functions ----------------------------------------------------------
+
+/**
+ * record a log message, use the DLOG_*() macros instead
+ * lock-free, does not format, can be called from ISRs and any thread
+ * the record is dropped if the ring is full, see dlog_get_dropped()
+ * @param   level   DLOG_LEVEL_ERROR ... DLOG_LEVEL_DEBUG
+ * @param   fmt     format string, must stay valid (string literal)
+ * @param   a0, a1, a2  raw arguments
+ */
+void dlog_write(uint8_t level, const char *fmt, uint64_t a0, uint64_t a1, uint64_t a2);
+
+/**
+ * read the next log record, raw, e.g. to send it to an offline decoder
+ * call from 1 context only (single consumer)
+ * @param   rec     pointer to copy the record to
+ * @return  =true: OK, rec is valid
+ *          =false: no records
+ */
+uint8_t dlog_read(dlog_record_t *rec);
+
+/**
+ * format and print the next log records (printf)
+ * call from 1 context only (single consumer), scheduler_run() does it, see scheduler_set_dlog_consumer()
+ * @param   max     number of records to print at most
+ * @return  number of printed records
+ */
+uint16_t dlog_flush(uint16_t max);
+
+/**
+ * get the number of dropped records (the ring was full)
+ * @return  number of dropped records
+ */
+uint32_t dlog_get_dropped(void);
+
+#endif // _DLOG_H_
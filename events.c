@@ -8,6 +8,7 @@
 // - includes ------------------------------------------------------------------
 //#define DEBUG_PRINTF_ON
 #include "debug_printf.h"
+#include "dlog.h"
 
 #include <string.h>
 #include <stdint.h>
@@ -15,66 +16,60 @@
 #include "events.h"
 #include "scheduler.h"
 #include "fifo.h"
+#include "replay.h"
 
 // - private variables ---------------------------------------------------------
-// - event main_fifo ---------------------------------------------------------------
-#define EVENTS_MAIN_FIFO_SIZE (32) /// number of events in event main_fifo
-
-static fifo_t events_main_fifo;
-static event_t events_main_fifo_data[EVENTS_MAIN_FIFO_SIZE];
-
-// - timer events --------------------------------------------------------------
-#define EV_TIMER_NB_EVENTS  (32)
-typedef struct {
-    uint32_t compare;
-	uint16_t ctrl;
-    event_t  event;
-} ev_tim_event_t;
-#define EV_TIMER_CTRL_ACTIVE (1<<0)
-
-static fifo_t events_timer_fifo;
-static ev_tim_event_t events_timer_fifo_data[EV_TIMER_NB_EVENTS];
-
-static task_t ev_timer_proc;
+#if defined(EVENTS_COMPACT) && !defined(EVENTS_LATENCY_ON)
+// compact layout: an event takes 8 bytes, a timer event 17 bytes in the arrays of events_ctx_t
+// (compare, event, ctrl, no padding), the stamp adds 4 bytes
+typedef char events_assert_event_size[(sizeof(event_t) <= 8) ? 1 : -1];
+typedef char events_assert_timer_event_size[(sizeof(((events_ctx_t *)0)->timer_compare) +
+	sizeof(((events_ctx_t *)0)->timer_event) + sizeof(((events_ctx_t *)0)->timer_ctrl) == 17 * EV_TIMER_NB_EVENTS) ? 1 : -1];
+#elif defined(EVENTS_COMPACT) && defined(EVENTS_LATENCY_ON)
+// compact layout with the stamp: an event takes 12 bytes, a timer event 21 bytes
+typedef char events_assert_event_size[(sizeof(event_t) <= 12) ? 1 : -1];
+typedef char events_assert_timer_event_size[(sizeof(((events_ctx_t *)0)->timer_compare) +
+	sizeof(((events_ctx_t *)0)->timer_event) + sizeof(((events_ctx_t *)0)->timer_ctrl) == 21 * EV_TIMER_NB_EVENTS) ? 1 : -1];
+#endif
 static char ev_timer_name[] = "EV_TIMER_HAL";
 
 // - private function ----------------------------------------------------------
 #ifdef DEBUG_PRINTF_ON
-void events_print_event_main_fifo(void) {
+void events_print_event_main_fifo(events_ctx_t *e) {
 	uint16_t pos;
 	DEBUG_PRINTF_MESSAGE("events_print_event_main_fifo\n");
 	DEBUG_PRINTF_MESSAGE(" wr: %d, rd:%d, size: %d\n",
-				events_main_fifo.wr,
-				events_main_fifo.rd,
-				events_main_fifo.size);
-	for(pos = fifo_next_pos(events_main_fifo.rd, events_main_fifo.size); pos != events_main_fifo.wr; pos = fifo_next_pos(pos, events_main_fifo.size)) {
+				e->main_fifo.wr,
+				e->main_fifo.rd,
+				e->main_fifo.size);
+	for(pos = fifo_next_pos(e->main_fifo.rd, e->main_fifo.size); pos != e->main_fifo.wr; pos = fifo_next_pos(pos, e->main_fifo.size)) {
 		DEBUG_PRINTF_MESSAGE(" pos: %d, tid: %d, event: 0x%02X\n", 
 				pos, 
-				events_main_fifo_data[pos].tid, 
-				events_main_fifo_data[pos].event);
+				e->main_fifo_data[pos].tid, 
+				e->main_fifo_data[pos].event);
 	}
 	DEBUG_PRINTF_MESSAGE(" pos: %d, tid: %d, event: 0x%02X\n", 
 				pos, 
-				events_main_fifo_data[pos].tid, 
-				events_main_fifo_data[pos].event);
+				e->main_fifo_data[pos].tid, 
+				e->main_fifo_data[pos].event);
 }
 #else
-#define events_print_event_main_fifo()
+#define events_print_event_main_fifo(e)
 #endif
 
 #ifdef DEBUG_PRINTF_ON
-void events_print_timer_events(void) {
+void events_print_timer_events(events_ctx_t *e) {
 	uint16_t pos;
 	DEBUG_PRINTF_MESSAGE("events_print_timer_events()\n");
-	DEBUG_PRINTF_MESSAGE(" wr: %d, rd:%d, size: %d\n", events_timer_fifo.wr, events_timer_fifo.rd, events_timer_fifo.size);
-	for(pos = fifo_next_pos(events_timer_fifo.rd, events_main_fifo.size); pos != events_timer_fifo.wr; pos = fifo_next_pos(pos, events_timer_fifo.size)) {
-	//for(pos = events_timer_fifo.rd; pos != events_timer_fifo.wr; pos = fifo_next_pos(pos, events_timer_fifo.size)) {
-		DEBUG_PRINTF_MESSAGE(" pos: %d, compare: %d, tid: %d, event: 0x%02X\n", pos, events_timer_fifo_data[pos].compare, events_timer_fifo_data[pos].event.tid, events_timer_fifo_data[pos].event.event);
+	DEBUG_PRINTF_MESSAGE(" wr: %d, rd:%d, size: %d\n", e->timer_fifo.wr, e->timer_fifo.rd, e->timer_fifo.size);
+	for(pos = fifo_next_pos(e->timer_fifo.rd, e->timer_fifo.size); pos != e->timer_fifo.wr; pos = fifo_next_pos(pos, e->timer_fifo.size)) {
+	//for(pos = e->timer_fifo.rd; pos != e->timer_fifo.wr; pos = fifo_next_pos(pos, e->timer_fifo.size)) {
+		DEBUG_PRINTF_MESSAGE(" pos: %d, compare: %llu, tid: %d, event: 0x%02X\n", pos, (unsigned long long)e->timer_compare[pos], e->timer_event[pos].tid, e->timer_event[pos].event);
 	}
-	DEBUG_PRINTF_MESSAGE(" pos: %d, compare: %d, tid: %d, event: 0x%02X\n", pos, events_timer_fifo_data[pos].compare, events_timer_fifo_data[pos].event.tid, events_timer_fifo_data[pos].event.event);
+	DEBUG_PRINTF_MESSAGE(" pos: %d, compare: %llu, tid: %d, event: 0x%02X\n", pos, (unsigned long long)e->timer_compare[pos], e->timer_event[pos].tid, e->timer_event[pos].event);
 }
 #else
-#define events_print_timer_events()
+#define events_print_timer_events(e)
 #endif
 
 // - timer callback, ISR -------------------------------------------------------
@@ -83,23 +78,19 @@ void events_print_timer_events(void) {
  * the event timer task
  * task the next event to send
  */
-#include <stdio.h>
-static uint32_t ev_timer_CNT = 0;
-static uint32_t ev_timer_COMPARE = 0;
-
-static inline void get_compare_from_timer_event_fifo(void) {
+static inline void get_compare_from_timer_event_fifo(events_ctx_t *e) {
 	uint16_t n;
-	ev_timer_COMPARE = 0; // if none available
+	e->timer_COMPARE = 0; // if none available
 	// find the 1st active timer interrupt
-	for(n = events_timer_fifo.size; n != 0; n --) {
-		if(fifo_try_get(&events_timer_fifo) == true) {
-			if((events_timer_fifo_data[events_timer_fifo.rd_proc].ctrl & EV_TIMER_CTRL_ACTIVE) == 0) {
+	for(n = e->timer_fifo.size; n != 0; n --) {
+		if(fifo_try_get(&e->timer_fifo) == true) {
+			if((e->timer_ctrl[e->timer_fifo.rd_proc] & EV_TIMER_CTRL_ACTIVE) == 0) {
 				// this timer event is not active, so skip this one
-				fifo_finalize_get(&events_timer_fifo);
+				fifo_finalize_get(&e->timer_fifo);
 			}
 			else {
 				// this timer event is active, take this one
-				ev_timer_COMPARE = events_timer_fifo_data[events_timer_fifo.rd_proc].compare;
+				e->timer_COMPARE = e->timer_compare[e->timer_fifo.rd_proc];
 				break;
 			}
 		}
@@ -108,282 +99,993 @@ static inline void get_compare_from_timer_event_fifo(void) {
 			break;
 		}
 	}
-	DEBUG_PRINTF_MESSAGE(" current compare: %d\n", ev_timer_COMPARE);
+	DLOG_DEBUG("current compare: %llu\n", e->timer_COMPARE);
 }
 
-static int8_t ev_timer_hal_task(uint8_t event, void *data) {
-	uint16_t n, sr;
-    ev_timer_CNT++;
-	printf("ev_timer_hal_task(ev: %d)\n", event);
-	printf("  CNT:     %d\n", ev_timer_CNT);
-	printf("  COMPARE: %d\n", ev_timer_COMPARE);
-	if(ev_timer_CNT == ev_timer_COMPARE) {
-		lock_interrupt(sr);
-		printf("  COMPARE == CNT\n");
-
-		for(n = events_timer_fifo.size; n != 0; n --) {
-			// get the first timer event
-			if(fifo_try_get(&events_timer_fifo) == true) {
-				if(events_timer_fifo_data[events_timer_fifo.rd_proc].ctrl & EV_TIMER_CTRL_ACTIVE) {
-					// this timer event is active, does it macht?
-					if(events_timer_fifo_data[events_timer_fifo.rd_proc].compare == ev_timer_CNT) {
-						// match: send the timer event and set this timer event inactive
-						printf("  match at CNT: %d\n", ev_timer_CNT);
-						scheduler_send_event(events_timer_fifo_data[events_timer_fifo.rd_proc].event.tid,
-							events_timer_fifo_data[events_timer_fifo.rd_proc].event.event,
-							events_timer_fifo_data[events_timer_fifo.rd_proc].event.data);
-						// this timer event is done, set it inactive
-						events_timer_fifo_data[events_timer_fifo.rd_proc].ctrl &= ~EV_TIMER_CTRL_ACTIVE;
-						fifo_finalize_get(&events_timer_fifo);
-						// now again check if there is yet an other timer event available
-						get_compare_from_timer_event_fifo();
-					}
-				}
-				else {
-					// this timer event was not active! get the next one, also do not compare
-					get_compare_from_timer_event_fifo();
-					break;
-				}
-			}
+#ifdef EV_TIMER_HOST_CLOCK
+// - host port: high resolution monotonic clock --------------------------------
+#include <time.h>
+
+static uint64_t ev_timer_host_clock_ns(events_ctx_t *e) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec - e->host_clock_start_ns;
+}
+#endif
+
+/**
+ * compare 2 times t1, t2, wrap arround safe
+ * (t1 and t2 must not be further apart than half the counter range)
+ * @return 	=+1: t1  > t2
+ * 			=0:  t1 == t2
+ * 			=-1: t1  < t2
+ */
+static int8_t events_compare_times(uint64_t t1, uint64_t t2) {
+	int64_t diff = (int64_t)(t1 - t2);
+	if(diff == 0) {
+		return 0;
+	}
+	if(diff > 0) {
+		return 1;
+	}
+	return -1;
+}
+
+// - timer compare scan --------------------------------------------------------
+// the timer events are sorted, the ones with compare <= t are at the start,
+// count them on the contiguous compare[] array, 4 (AVX2) or 2 (SSE2) at a time
+// define EV_TIMER_SCAN_SCALAR to use the scalar version on x86 too
+#if !defined(EV_TIMER_SCAN_SCALAR) && (defined(__AVX2__) || defined(__SSE2__))
+#include <immintrin.h>
+#endif
+
+/**
+ * count the sorted compare values <= t (wrap arround safe), stop at the 1st one > t
+ * @param	compare		sorted compare values
+ * @param	n			number of compare values
+ * @param	t			time to compare with
+ * @return	number of compare values <= t
+ */
+static uint16_t events_count_compare_le(const uint64_t *compare, uint16_t n, uint64_t t) {
+	uint16_t i = 0;
+#if !defined(EV_TIMER_SCAN_SCALAR) && defined(__AVX2__)
+	// compare <= t: compare - (t + 1) is negative, its sign bit is set
+	__m256i vt = _mm256_set1_epi64x((long long)(t + 1));
+	int le;
+	for(; (i + 4) <= n; i += 4) {
+		le = _mm256_movemask_pd(_mm256_castsi256_pd(
+			_mm256_sub_epi64(_mm256_loadu_si256((const __m256i *)&compare[i]), vt)));
+		if(le != 0x0F) {
+			// the 1st compare > t is in this block
+			return i + __builtin_ctz(~le);
+		}
+	}
+#elif !defined(EV_TIMER_SCAN_SCALAR) && defined(__SSE2__)
+	// compare <= t: compare - (t + 1) is negative, its sign bit is set, 2 blocks at a time
+	__m128i vt = _mm_set1_epi64x((long long)(t + 1));
+	int le;
+	for(; (i + 4) <= n; i += 4) {
+		le = _mm_movemask_pd(_mm_castsi128_pd(_mm_sub_epi64(_mm_loadu_si128((const __m128i *)&compare[i]), vt))) |
+			(_mm_movemask_pd(_mm_castsi128_pd(_mm_sub_epi64(_mm_loadu_si128((const __m128i *)&compare[i + 2]), vt))) << 2);
+		if(le != 0x0F) {
+			// the 1st compare > t is in this block
+			return i + __builtin_ctz(~le);
+		}
+	}
+#endif
+	for(; i < n; i++) {
+		if(events_compare_times(compare[i], t) > 0) {
+			break;
 		}
 	}
+	return i;
+}
+
+/**
+ * count the timer events with compare <= t, they are at the start of the sorted timer_fifo
+ * @param	t		time to compare with
+ * @return	number of timer events with compare <= t
+ */
+static uint16_t events_count_timer_events_le(events_ctx_t *e, uint64_t t) {
+	uint16_t first, last, n, cnt;
+
+	if(fifo_is_empty(&e->timer_fifo) == true) {
+		return 0;
+	}
+	first = fifo_next_pos(e->timer_fifo.rd, e->timer_fifo.size);
+	last = e->timer_fifo.wr;
+	if(first <= last) {
+		return events_count_compare_le(&e->timer_compare[first], last - first + 1, t);
+	}
+	// wraps arround: end of the array, then its start
+	n = e->timer_fifo.size - first;
+	cnt = events_count_compare_le(&e->timer_compare[first], n, t);
+	if(cnt < n) {
+		return cnt;
+	}
+	return cnt + events_count_compare_le(&e->timer_compare[0], last + 1, t);
+}
+
+static int8_t ev_timer_hal_task(uint8_t event, void *data) {
+	// the event timer of the scheduler instance that runs this task
+	events_ctx_t *e = &scheduler_get_ctx()->events;
+	uint16_t sr;
+	uint64_t ticks;
+
+	if(event == EV_STOP) {
+		// event timer gets stopped, this is not a tick
+		return(0);
+	}
 
+	lock_interrupt(sr);
+#ifdef EV_TIMER_HOST_CLOCK
+	// host port: follow the monotonic clock, never go backwards
+	ticks = events_ns_to_ticks(ev_timer_host_clock_ns(e));
+	if(ticks > e->timer_CNT) {
+		e->timer_CNT = ticks;
+	}
+	e->timer_ticks_pending = 0;
+#else
+	// catch up on all ticks since the last run, at least 1 tick per call
+	ticks = e->timer_ticks_pending;
+	e->timer_ticks_pending = 0;
+	if(ticks == 0) {
+		ticks = 1;
+	}
+	e->timer_CNT += ticks;
+#endif
+	e->timer_tick_posted = false;
+	DLOG_DEBUG("ev_timer_hal_task(ev: %llu), CNT: %llu, COMPARE: %llu\n", event, e->timer_CNT, e->timer_COMPARE);
+	// collect the due timer events (compare <= CNT) with 1 scan, the scheduler
+	// dispatches them in deadline order, see events_ctx_get_due_timer_event()
+	e->timer_due = events_count_timer_events_le(e, e->timer_CNT);
 	restore_interrupt(sr);
     return(1);
 }
 
-static uint32_t ev_timer_get_current_time(void) {
-    uint32_t time;
+static uint64_t ev_timer_get_current_time(events_ctx_t *e) {
+    uint64_t time;
     uint16_t sr;
     
+#ifdef EV_TIMER_HOST_CLOCK
+    // host port: the clock runs ahead of e->timer_CNT until the timer task runs
+    time = events_ns_to_ticks(ev_timer_host_clock_ns(e));
+#else
     lock_interrupt(sr);
-    time = ev_timer_CNT;
+    time = e->timer_CNT;
     restore_interrupt(sr);
+#endif
 
     return time;
 }
 
-static uint32_t ev_timer_get_current_time_isr(void) {
-    return ev_timer_CNT;
+/**
+ * copy 1 timer event within the timer event arrays (SoA)
+ * @param	dst		position to copy to
+ * @param	src		position to copy from
+ */
+static inline void events_copy_timer_event(events_ctx_t *e, uint16_t dst, uint16_t src) {
+	e->timer_compare[dst] = e->timer_compare[src];
+	e->timer_ctrl[dst] = e->timer_ctrl[src];
+	e->timer_event[dst] = e->timer_event[src];
 }
 
 /**
- * compare 2 times t1, t2
- * @return 	=+1: t1  > t2
- * 			=0:  t1 == t2
- * 			=-1: t1  < t2
+ * move a block of timer events within the timer event arrays (SoA)
+ * @param	dst		position to move to
+ * @param	src		position to move from
+ * @param	n		number of timer events, the block must not wrap arround
  */
-static int8_t events_compare_times(uint32_t t1, uint32_t t2) {
-	if(t1 == t2) {
-		return 0;
-	}
-	if(t1 > t2) {
-		return 1;
-	}
-	return -1;
+static inline void events_move_timer_events(events_ctx_t *e, uint16_t dst, uint16_t src, uint16_t n) {
+	memmove(&e->timer_compare[dst], &e->timer_compare[src], n * sizeof(e->timer_compare[0]));
+	memmove(&e->timer_ctrl[dst], &e->timer_ctrl[src], n * sizeof(e->timer_ctrl[0]));
+	memmove(&e->timer_event[dst], &e->timer_event[src], n * sizeof(e->timer_event[0]));
 }
 
 /**
- * move the elements in events_timer_fifo_data 1 position to the right
+ * move the timer events 1 position to the right
  * to make space for 1 new element
  * use vars 
- * events_timer_fifo (do not change)
- * events_timer_fifo_data (change)
+ * e->timer_fifo (do not change)
+ * e->timer_compare, _ctrl, _event (change)
  * @param	from	start position to move from
  * @param	to		end position
  */
-static void events_move_elements_in_timer_fifo_right(uint16_t from, uint16_t to) {
-	uint16_t pos, pos1;
-	for(pos  = from;pos != to;pos  = pos1) {
-		pos1 = fifo_prev_pos(pos, events_timer_fifo.size);
-		memcpy(&events_timer_fifo_data[pos], &events_timer_fifo_data[pos1], sizeof(events_timer_fifo_data[pos]));
+static void events_move_elements_in_timer_fifo_right(events_ctx_t *e, uint16_t from, uint16_t to) {
+	uint16_t last = e->timer_fifo.size - 1;
+	if(from < to) {
+		// wraps arround: move the start of the arrays, then the last element to the start
+		events_move_timer_events(e, 1, 0, from);
+		events_copy_timer_event(e, 0, last);
+		from = last;
 	}
+	events_move_timer_events(e, to + 1, to, from - to);
 }
 
 // - public functions ----------------------------------------------------------
-void events_init(void) {
+void events_ctx_init(events_ctx_t *e, struct scheduler_ctx_s *sched) {
+	uint16_t n;
+	e->sched = sched;
 	// event main_fifo
-	fifo_init(&events_main_fifo, (void *)events_main_fifo_data, EVENTS_MAIN_FIFO_SIZE);
-	memset((uint8_t *)events_main_fifo_data, 0, sizeof(events_main_fifo_data));
+	fifo_init(&e->main_fifo, (void *)e->main_fifo_data, EVENTS_MAIN_FIFO_SIZE);
+	memset((uint8_t *)e->main_fifo_data, 0, sizeof(e->main_fifo_data));
+	// event groups 1 ...
+	for(n = 0; n < (EVENTS_NB_OF_GROUPS - 1); n++) {
+		fifo_init(&e->group_fifo[n], (void *)e->group_fifo_data[n], EVENTS_GROUP_FIFO_SIZE);
+	}
+	memset((uint8_t *)e->group_fifo_data, 0, sizeof(e->group_fifo_data));
 	// timing events
-    memset(&ev_timer_proc, 0, sizeof(ev_timer_proc));
-    memset(&events_timer_fifo_data, 0, sizeof(events_timer_fifo_data));
-    fifo_init(&events_timer_fifo, events_timer_fifo_data, EV_TIMER_NB_EVENTS);
+    memset(&e->timer_proc, 0, sizeof(e->timer_proc));
+    memset(e->timer_compare, 0, sizeof(e->timer_compare));
+    memset(e->timer_ctrl, 0, sizeof(e->timer_ctrl));
+    memset(e->timer_event, 0, sizeof(e->timer_event));
+    fifo_init(&e->timer_fifo, e->timer_event, EV_TIMER_NB_EVENTS);
 
-    ev_timer_CNT = 0;
-    ev_timer_proc.name = ev_timer_name;
-    ev_timer_proc.task = ev_timer_hal_task;
-    scheduler_add_task(&ev_timer_proc);
+    e->timer_CNT = 0;
+    e->timer_COMPARE = 0;
+#ifdef EV_TIMER_HOST_CLOCK
+    e->host_clock_start_ns = 0;
+    e->host_clock_start_ns = ev_timer_host_clock_ns(e);
+#endif
+    e->timer_ticks_pending = 0;
+    e->timer_tick_posted = false;
+    e->timer_due = 0;
+    memset(&e->timer_stats, 0, sizeof(e->timer_stats));
+    for(n = 0; n < EV_TIMER_STAGE_SIZE; n++) {
+        atomic_store(&e->timer_stage[n].seq, n);
+    }
+    atomic_store(&e->timer_stage_wr, 0);
+    e->timer_stage_rd = 0;
+    e->timer_proc.name = ev_timer_name;
+    e->timer_proc.task = ev_timer_hal_task;
+    scheduler_ctx_add_task(sched, &e->timer_proc);
 }
 
-uint8_t events_add_to_main_fifo(event_t *ev) {
+/**
+ * get the fifo of an event group, group 0 is the main_fifo
+ * @param	group	event group, < EVENTS_NB_OF_GROUPS
+ * @param	data	pointer to store the event array of the fifo
+ * @return	fifo of the group, =NULL: no such group
+ */
+static inline fifo_t *events_group_fifo(events_ctx_t *e, uint8_t group, event_t **data) {
+	if(group == 0) {
+		*data = e->main_fifo_data;
+		return &e->main_fifo;
+	}
+	if(group >= EVENTS_NB_OF_GROUPS) {
+		return NULL;
+	}
+	*data = e->group_fifo_data[group - 1];
+	return &e->group_fifo[group - 1];
+}
+
+uint8_t events_ctx_add_to_main_fifo(events_ctx_t *e, event_t *ev) {
+	return events_ctx_add_to_group_fifo(e, 0, ev);
+}
+
+uint8_t events_ctx_add_to_group_fifo(events_ctx_t *e, uint8_t group, event_t *ev) {
+	event_t *data;
+	fifo_t *f;
 	uint16_t sr;
-	DEBUG_PRINTF_MESSAGE("events_main_fifo_write: (wr: %d, rd:%d, size: %d)",
-				events_main_fifo.wr,
-				events_main_fifo.rd,
-				events_main_fifo.size);
 	// sanity checks
-	if(ev == NULL) {
-		DEBUG_PRINTF_MESSAGE(" ev == NULL\n");
+	if((ev == NULL) || ((f = events_group_fifo(e, group, &data)) == NULL)) {
+		DLOG_DEBUG("events_add_to_group_fifo(group: %llu): ev == NULL or no such group\n", group);
 		return false;
 	}
+#ifdef EVENTS_LATENCY_ON
+	// queued now, the queueing delay runs from here
+	ev->stamp = (uint32_t)events_ctx_get_time_ns(e);
+#endif
 	lock_interrupt(sr);
-	if(fifo_try_append(&events_main_fifo) == false) {
+	if(fifo_try_append(f) == false) {
 		// cannot append
-		DEBUG_PRINTF_MESSAGE(" event main_fifo is full\n");
+		DLOG_DEBUG("events_add_to_group_fifo(tid: %llu, event: %llu, group: %llu): fifo is full\n", ev->tid, ev->event, group);
 		restore_interrupt(sr);
 		return false;
 	}
-	memcpy((uint8_t *)&events_main_fifo_data[events_main_fifo.wr_proc], (uint8_t *)ev, sizeof(*ev));
-	fifo_finalize_append(&events_main_fifo);
-	DEBUG_PRINTF_MESSAGE(" event: tid: %d, event: %d, data: %p (wr: %d, rd:%d, size: %d)\n",
-				ev->tid, ev->event, ev->data,
-				events_main_fifo.wr,
-				events_main_fifo.rd,
-				events_main_fifo.size);
-	events_print_event_main_fifo();
+	memcpy((uint8_t *)&data[f->wr_proc], (uint8_t *)ev, sizeof(*ev));
+	fifo_finalize_append(f);
+	DLOG_DEBUG("events_add_to_group_fifo(tid: %llu, event: %llu, group: %llu)\n",
+				ev->tid, ev->event, group);
+	events_print_event_main_fifo(e);
 
 	restore_interrupt(sr);
 	return true;
 }
 
-uint8_t events_get_from_main_fifo(event_t *ev) {
+uint8_t events_ctx_get_from_main_fifo(events_ctx_t *e, event_t *ev) {
+	return events_ctx_get_from_group_fifo(e, 0, ev);
+}
+
+uint8_t events_ctx_get_from_group_fifo(events_ctx_t *e, uint8_t group, event_t *ev) {
+	event_t *data;
+	fifo_t *f;
 	uint16_t sr;
-	DEBUG_PRINTF_MESSAGE("events_get_from_main_fifo():  (wr: %d, rd:%d, size: %d)\n",
-				events_main_fifo.wr, events_main_fifo.rd, events_main_fifo.size);
     // sanity checks
-	if(ev == NULL) {
-		DEBUG_PRINTF_MESSAGE(" ev == NULL\n");
+	if((ev == NULL) || ((f = events_group_fifo(e, group, &data)) == NULL)) {
+		DLOG_DEBUG("events_get_from_group_fifo(group: %llu): ev == NULL or no such group\n", group);
 		return false;
 	}
-	lock_interrupt(sr); restore_interrupt(sr);
-	if(fifo_try_get(&events_main_fifo) == false) {
-		// cannot append
-		DEBUG_PRINTF_MESSAGE(" event main_fifo is empty\n");
+	lock_interrupt(sr);
+	if(fifo_try_get(f) == false) {
+		// cannot get, fifo is empty
+		restore_interrupt(sr);
 		return false;
 	}
-	memcpy((uint8_t *)ev, (uint8_t *)&events_main_fifo_data[events_main_fifo.rd_proc], sizeof(*ev));
-	fifo_finalize_get(&events_main_fifo);
-	DEBUG_PRINTF_MESSAGE(" event: tid: %d, event: %d, data: %p (wr: %d, rd:%d, size: %d)\n", 
-				ev->tid, ev->event, ev->data, events_main_fifo.wr, events_main_fifo.rd, events_main_fifo.size);
+	memcpy((uint8_t *)ev, (uint8_t *)&data[f->rd_proc], sizeof(*ev));
+	fifo_finalize_get(f);
+	DLOG_DEBUG("events_get_from_group_fifo(tid: %llu, event: %llu, group: %llu)\n",
+				ev->tid, ev->event, group);
 	restore_interrupt(sr);
 	return true;
 }
 
-uint8_t events_is_main_fifo_empty(void) {
-    return fifo_is_empty(&events_main_fifo);
+uint8_t events_ctx_is_main_fifo_empty(events_ctx_t *e) {
+	uint8_t group;
+	for(group = 0; group < EVENTS_NB_OF_GROUPS; group++) {
+		if(events_ctx_is_group_fifo_empty(e, group) == false) {
+			return false;
+		}
+	}
+	return true;
+}
+
+uint8_t events_ctx_peek_main_fifo(events_ctx_t *e, event_t *ev) {
+	event_t *data;
+	fifo_t *f;
+	uint16_t sr;
+	uint8_t group;
+
+	if(ev == NULL) {
+		return false;
+	}
+	lock_interrupt(sr);
+	for(group = 0; group < EVENTS_NB_OF_GROUPS; group++) {
+		f = events_group_fifo(e, group, &data);
+		if(fifo_is_empty(f) == false) {
+			// entries are at (rd, wr]
+			memcpy(ev, &data[fifo_next_pos(f->rd, f->size)], sizeof(*ev));
+			restore_interrupt(sr);
+			return true;
+		}
+	}
+	restore_interrupt(sr);
+	return false;
+}
+
+uint8_t events_ctx_is_group_fifo_empty(events_ctx_t *e, uint8_t group) {
+	event_t *data;
+	fifo_t *f;
+	if((f = events_group_fifo(e, group, &data)) == NULL) {
+		return true;
+	}
+    return fifo_is_empty(f);
+}
+
+uint16_t events_ctx_purge_main_fifo(events_ctx_t *e, uint8_t tid) {
+	uint16_t cnt;
+	cnt = events_ctx_take_from_main_fifo(e, tid, NULL, 0xFFFF);
+	DLOG_DEBUG("events_purge_main_fifo(tid: %llu): %llu events removed\n", tid, cnt);
+	return cnt;
+}
+
+uint16_t events_ctx_take_from_main_fifo(events_ctx_t *e, uint8_t tid, event_t *evs, uint16_t max) {
+	uint16_t cnt = 0;
+	uint8_t group;
+	// the events of a task are in 1 group
+	for(group = 0; (group < EVENTS_NB_OF_GROUPS) && (cnt < max); group++) {
+		cnt += events_ctx_take_from_group_fifo(e, group, tid, (evs != NULL) ? &evs[cnt] : NULL, max - cnt);
+	}
+	return cnt;
+}
+
+uint16_t events_ctx_take_from_group_fifo(events_ctx_t *e, uint8_t group, uint8_t tid, event_t *evs, uint16_t max) {
+	uint16_t sr, src, dst, cnt = 0;
+	event_t *data;
+	fifo_t *f;
+
+	if((f = events_group_fifo(e, group, &data)) == NULL) {
+		return 0;
+	}
+	lock_interrupt(sr);
+	if(fifo_is_empty(f) == true) {
+		restore_interrupt(sr);
+		return 0;
+	}
+	// compact in place, keep the order of all other events
+	dst = fifo_next_pos(f->rd, f->size);
+	for(src = dst; ; src = fifo_next_pos(src, f->size)) {
+		if((data[src].tid == tid) && (cnt < max)) {
+			if(evs != NULL) {
+				memcpy(&evs[cnt], &data[src], sizeof(evs[cnt]));
+			}
+			cnt++;
+		}
+		else {
+			if(dst != src) {
+				memcpy(&data[dst], &data[src], sizeof(data[dst]));
+			}
+			dst = fifo_next_pos(dst, f->size);
+		}
+		if(src == f->wr) {
+			break;
+		}
+	}
+	// wr points to the last kept event (=rd if none kept)
+	f->wr = fifo_prev_pos(dst, f->size);
+	restore_interrupt(sr);
+	return cnt;
 }
 
 // - timing events -------------------------------------------------------------
 
-int8_t events_start_timer(uint16_t periode) {
+int8_t events_ctx_start_timer(events_ctx_t *e, uint16_t periode) {
 	// start the timer
-    return scheduler_start_task(ev_timer_proc.tid);
+    return scheduler_ctx_start_task(e->sched, e->timer_proc.tid);
 }
 
-int8_t events_stop_timer(void) {
-    return scheduler_stop_task(ev_timer_proc.tid);
+int8_t events_ctx_stop_timer(events_ctx_t *e) {
+    return scheduler_ctx_stop_task(e->sched, e->timer_proc.tid);
+}
+
+void events_ctx_timer_tick(events_ctx_t *e, uint32_t ticks) {
+	uint16_t sr;
+	uint8_t post;
+
+	lock_interrupt(sr);
+	e->timer_ticks_pending += ticks;
+	// only 1 tick event in the main_fifo at a time, the timer task catches up on all pending ticks
+	post = (e->timer_tick_posted == false);
+	e->timer_tick_posted = true;
+	restore_interrupt(sr);
+	if(post) {
+		if(scheduler_ctx_send_event(e->sched, e->timer_proc.tid, EV_POLL, NULL) == false) {
+			// main_fifo is full, ticks stay pending, try again on the next tick
+			e->timer_tick_posted = false;
+		}
+	}
+}
+
+void events_ctx_timer_poll(events_ctx_t *e) {
+#ifdef EV_TIMER_HOST_CLOCK
+	uint16_t sr;
+	uint8_t due;
+
+	lock_interrupt(sr);
+	due = (e->timer_tick_posted == false) &&
+		(fifo_is_empty(&e->timer_fifo) == false) &&
+		(events_compare_times(e->timer_COMPARE, events_ns_to_ticks(ev_timer_host_clock_ns(e))) <= 0);
+	restore_interrupt(sr);
+	if(due) {
+		// the timer task reads the clock itself, no ticks to add
+		events_ctx_timer_tick(e, 0);
+	}
+#else
+	(void)e; // tick mode: the timer ISR calls events_ctx_timer_tick()
+#endif
+}
+
+uint16_t events_ctx_purge_timer_events(events_ctx_t *e, uint8_t tid) {
+	uint16_t cnt;
+	cnt = events_ctx_cancel_timer_events(e, tid, EV_ANY);
+	DLOG_DEBUG("events_purge_timer_events(tid: %llu): %llu timer events removed\n", tid, cnt);
+	return cnt;
+}
+
+uint16_t events_ctx_cancel_timer_events(events_ctx_t *e, uint8_t tid, uint8_t event) {
+	uint16_t sr, src, dst, cnt = 0;
+
+	lock_interrupt(sr);
+	if(fifo_is_empty(&e->timer_fifo) == true) {
+		restore_interrupt(sr);
+		return 0;
+	}
+	// compact in place, the remaining timer events stay sorted, drop inactive ones too
+	dst = fifo_next_pos(e->timer_fifo.rd, e->timer_fifo.size);
+	for(src = dst; ; src = fifo_next_pos(src, e->timer_fifo.size)) {
+		if(((e->timer_ctrl[src] & EV_TIMER_CTRL_ACTIVE) == 0) ||
+		   ((e->timer_event[src].tid == tid) && ((event == EV_ANY) || (e->timer_event[src].event == event)))) {
+			if((e->timer_ctrl[src] & EV_TIMER_CTRL_ACTIVE) && (e->timer_event[src].tid == SCHEDULER_TID_DEFER)) {
+				// this deferred call will not run, free it
+				scheduler_ctx_cancel_defer(e->sched, (uint8_t)(uintptr_t)EVENT_DATA_UNPACK(e->timer_event[src].data));
+			}
+			cnt++;
+		}
+		else {
+			if(dst != src) {
+				events_copy_timer_event(e, dst, src);
+			}
+			dst = fifo_next_pos(dst, e->timer_fifo.size);
+		}
+		if(src == e->timer_fifo.wr) {
+			break;
+		}
+	}
+	e->timer_fifo.wr = fifo_prev_pos(dst, e->timer_fifo.size);
+	get_compare_from_timer_event_fifo(e);
+	e->timer_due = events_count_timer_events_le(e, e->timer_CNT);
+	restore_interrupt(sr);
+	return cnt;
+}
+
+uint8_t events_ctx_get_due_timer_event(events_ctx_t *e, event_t *ev) {
+	uint64_t lateness, compare;
+	uint16_t sr, pos;
+
+	lock_interrupt(sr);
+	while((e->timer_due != 0) && (fifo_try_get(&e->timer_fifo) == true)) {
+		e->timer_due--;
+		pos = e->timer_fifo.rd_proc;
+		if((e->timer_ctrl[pos] & EV_TIMER_CTRL_ACTIVE) == 0) {
+			// this timer event is not active, skip it
+			fifo_finalize_get(&e->timer_fifo);
+			continue;
+		}
+		// due: record how late it was, hand it to the scheduler
+		compare = e->timer_compare[pos];
+		lateness = e->timer_CNT - compare;
+		e->timer_stats.expired++;
+		if(lateness) {
+			e->timer_stats.late++;
+			e->timer_stats.lateness_sum += lateness;
+			if(lateness > e->timer_stats.lateness_max) {
+				e->timer_stats.lateness_max = lateness;
+			}
+		}
+		DLOG_DEBUG("match at CNT: %llu (compare: %llu, tid: %llu)\n", e->timer_CNT, compare, e->timer_event[pos].tid);
+		memcpy(ev, &e->timer_event[pos], sizeof(*ev));
+#ifdef EVENTS_LATENCY_ON
+		// became due at its deadline, the lateness counts as queueing delay
+		ev->stamp = (uint32_t)events_ticks_to_ns(compare);
+#endif
+		// this timer event is done, set it inactive
+		e->timer_ctrl[pos] &= ~EV_TIMER_CTRL_ACTIVE;
+		fifo_finalize_get(&e->timer_fifo);
+		get_compare_from_timer_event_fifo(e);
+		restore_interrupt(sr);
+		return true;
+	}
+	e->timer_due = 0;
+	restore_interrupt(sr);
+	return false;
+}
+
+uint8_t events_ctx_peek_timer_event(events_ctx_t *e, event_t *ev) {
+	uint16_t sr, pos;
+
+	if(ev == NULL) {
+		return false;
+	}
+	lock_interrupt(sr);
+	// sorted by deadline, skip the cancelled ones
+	for(pos = e->timer_fifo.rd; pos != e->timer_fifo.wr; ) {
+		pos = fifo_next_pos(pos, e->timer_fifo.size);
+		if(e->timer_ctrl[pos] & EV_TIMER_CTRL_ACTIVE) {
+			memcpy(ev, &e->timer_event[pos], sizeof(*ev));
+			restore_interrupt(sr);
+			return true;
+		}
+	}
+	restore_interrupt(sr);
+	return false;
 }
 
-static inline uint32_t events_calc_compare(uint32_t now, uint16_t timeout) {
-	// + -> this takes care of wrap arround it self
-	return now + timeout;
+int8_t events_ctx_timer_next_deadline(events_ctx_t *e, uint64_t *deadline) {
+	uint16_t sr;
+	int8_t ret;
+
+	lock_interrupt(sr);
+	// e->timer_COMPARE is valid as long as there are timer events
+	ret = (fifo_is_empty(&e->timer_fifo) == false);
+	if(ret && (deadline != NULL)) {
+		*deadline = e->timer_COMPARE;
+	}
+	restore_interrupt(sr);
+	return ret;
 }
 
-static inline uint16_t events_calc_timeout(uint32_t now, uint32_t compare) {
-	// compare lies ahead of now
-	// - -> take care of wrap arround
-	if(now <= compare) {
-		return compare - now;
+int8_t events_ctx_get_timer_stats(events_ctx_t *e, events_timer_stats_t *stats) {
+	uint16_t sr;
+	if(stats == NULL) {
+		return false;
 	}
-	return 0xFFFFFFFF - now + compare;
+	lock_interrupt(sr);
+	memcpy(stats, &e->timer_stats, sizeof(*stats));
+	restore_interrupt(sr);
+	return true;
 }
 
-int8_t events_add_single_timer_event(uint16_t timeout, event_t *ev)  {
-	uint32_t new_compare, pos_compare, now = 0;
-    uint16_t sr, pos, pos_timeout, pos_ctrl;
+void events_ctx_reset_timer_stats(events_ctx_t *e) {
+	uint16_t sr;
+	lock_interrupt(sr);
+	memset(&e->timer_stats, 0, sizeof(e->timer_stats));
+	restore_interrupt(sr);
+}
 
+// - time base -----------------------------------------------------------------
+uint64_t events_ctx_get_time_ticks(events_ctx_t *e) {
+	return ev_timer_get_current_time(e);
+}
+
+uint64_t events_ctx_get_time_ns(events_ctx_t *e) {
+#ifdef EV_TIMER_HOST_CLOCK
+	// host port: full resolution of the monotonic clock
+	return ev_timer_host_clock_ns(e);
+#else
+	return events_ticks_to_ns(ev_timer_get_current_time(e));
+#endif
+}
+
+uint64_t events_ctx_get_clock_ticks(events_ctx_t *e) {
+#ifdef EV_TIMER_HOST_CLOCK
+	return ev_timer_get_current_time(e);
+#else
+	uint64_t time;
+	uint16_t sr;
+
+	lock_interrupt(sr);
+	// timer_CNT only advances when the timer task runs
+	time = e->timer_CNT + e->timer_ticks_pending;
+	restore_interrupt(sr);
+	return time;
+#endif
+}
+
+uint64_t events_ctx_get_clock_ns(events_ctx_t *e) {
+#ifdef EV_TIMER_HOST_CLOCK
+	return ev_timer_host_clock_ns(e);
+#else
+	return events_ticks_to_ns(events_ctx_get_clock_ticks(e));
+#endif
+}
+
+uint64_t events_ticks_to_ns(uint64_t ticks) {
+	// split in seconds and remainder, so ticks * 10^9 cannot overflow
+	return (ticks / EV_TIMER_TICK_HZ) * 1000000000ull +
+		((ticks % EV_TIMER_TICK_HZ) * 1000000000ull) / EV_TIMER_TICK_HZ;
+}
+
+uint64_t events_ns_to_ticks(uint64_t ns) {
+	return (ns / 1000000000ull) * EV_TIMER_TICK_HZ +
+		((ns % 1000000000ull) * EV_TIMER_TICK_HZ) / 1000000000ull;
+}
+
+int8_t events_ctx_add_single_timer_event(events_ctx_t *e, uint32_t timeout, event_t *ev)  {
     // sanity check
 	if(ev == NULL) {
-		DEBUG_PRINTF_MESSAGE(" ev == NULL\n");
+		DLOG_DEBUG("events_add_single_timer_event(): ev == NULL\n");
 		return false;
 	}
-	DEBUG_PRINTF_MESSAGE("events_add_single_timer_event(%d, %d, %d)\n", timeout, ev->tid, ev->event);
     if(timeout == 0) {
         // invalid timeout
-        DEBUG_PRINTF_MESSAGE(" timeout = 0, skip\n");
+        DLOG_DEBUG("events_add_single_timer_event(tid: %llu, event: %llu): timeout = 0, skip\n", ev->tid, ev->event);
         return false;
     }
-    
+	// + -> no wrap arround with 64 bit ticks
+	return events_ctx_add_single_timer_event_at(e, ev_timer_get_current_time(e) + timeout, ev);
+}
+
+int8_t events_ctx_add_single_timer_event_at(events_ctx_t *e, uint64_t deadline, event_t *ev)  {
+	uint64_t new_compare;
+    uint16_t sr, pos;
+
+    // sanity check
+	if(ev == NULL) {
+		DLOG_DEBUG("events_add_single_timer_event_at(): ev == NULL\n");
+		return false;
+	}
+	DLOG_DEBUG("events_add_single_timer_event_at(%llu, tid: %llu, event: %llu)\n", deadline, ev->tid, ev->event);
+
     lock_interrupt(sr);
-	// calc compare for this event
-    now = ev_timer_get_current_time_isr();
-	new_compare = events_calc_compare(now, timeout);
+	// a deadline in the past is due right away (compare <= CNT)
+	new_compare = deadline;
 
     // get next free element
-    if(fifo_try_append(&events_timer_fifo) == false) {
+    if(fifo_try_append(&e->timer_fifo) == false) {
 		// cannot append
-		DEBUG_PRINTF_MESSAGE(" events_timer_fifo fifo is full, skip\n");
+		DLOG_WARN("events_add_single_timer_event_at(tid: %llu, event: %llu): no more timer events, skip\n", ev->tid, ev->event);
         restore_interrupt(sr);
 		return false;
 	}
     // find position to sort this event in
-	if(fifo_is_empty(&events_timer_fifo) == true) {
+	if(fifo_is_empty(&e->timer_fifo) == true) {
 		// fifo is empty, so save event
-		DEBUG_PRINTF_MESSAGE(" events_timer_fifo fifo is empty, place up front, done\n");
-		events_timer_fifo_data[events_timer_fifo.wr_proc].compare = new_compare;
-		events_timer_fifo_data[events_timer_fifo.wr_proc].ctrl = EV_TIMER_CTRL_ACTIVE;
-		events_timer_fifo_data[events_timer_fifo.wr_proc].event.data = ev->data;
-		events_timer_fifo_data[events_timer_fifo.wr_proc].event.tid  = ev->tid;
-		events_timer_fifo_data[events_timer_fifo.wr_proc].event.event  = ev->event;
+		e->timer_compare[e->timer_fifo.wr_proc] = new_compare;
+		e->timer_ctrl[e->timer_fifo.wr_proc] = EV_TIMER_CTRL_ACTIVE;
+		e->timer_event[e->timer_fifo.wr_proc].data = ev->data;
+		e->timer_event[e->timer_fifo.wr_proc].tid  = ev->tid;
+		e->timer_event[e->timer_fifo.wr_proc].event  = ev->event;
 	}
 	else {
-		/* iterate through events_timer_fifo to find appropriate place fro new_compare
+		/* find the appropriate place for new_compare: after all timer events with compare <= new_compare
+		 * (these come 1st, also the ones with the same compare), count them with 1 scan
 		 * note: use wr_proc here, because fifo_try_append() was called to check if there is space left
 		 * fifo_finalize_append() will get called later
 		 */
-		DEBUG_PRINTF_MESSAGE(" sort timer event to correct position\n");
-		for(pos = fifo_next_pos(events_timer_fifo.rd, events_main_fifo.size); pos != events_timer_fifo.wr_proc; pos = fifo_next_pos(pos, events_timer_fifo.size)) {
-			DEBUG_PRINTF_MESSAGE(" + pos: %d\n", pos);
-			/* check timeout values, pos_timeout(@pos) vs. timeout (from call)
-			* < : pos_timeout(@pos) will be used 1st, nothing to do
-			* ==: pos_timeout(@pos) will also be used 1st, nothing to do
-			* > : timeout will be used 1st, so make space at pos by copy pos to pos+1
-			*/
-			pos_ctrl = events_timer_fifo_data[pos].ctrl;
-			pos_compare = events_timer_fifo_data[pos].compare;
-			pos_timeout = events_calc_timeout(now, pos_compare);
-			DEBUG_PRINTF_MESSAGE("   pos_compare: %d, new_compare: %d, pos_ctrl: %d\n", pos_compare, new_compare, events_timer_fifo_data[pos].ctrl);
-			DEBUG_PRINTF_MESSAGE("   pos_timeout: %d, new_timeout: %d\n", pos_timeout, timeout);
-			//if(events_compare_times(pos_compare, new_compare) == -1) {
-			if((pos_ctrl & EV_TIMER_CTRL_ACTIVE) == 0) {
-				DEBUG_PRINTF_MESSAGE("   pos_ctrl unused, put new timeout here at pos\n");
-				// found an empty place, put new timeout here at pos
+		pos = fifo_next_pos(e->timer_fifo.rd, e->timer_fifo.size) + events_count_timer_events_le(e, new_compare);
+		if(pos >= e->timer_fifo.size) {
+			pos -= e->timer_fifo.size;
+		}
+		if(pos != e->timer_fifo.wr_proc) {
+			// new_compare will be used before the timer event @pos, make space at pos
+			events_move_elements_in_timer_fifo_right(e, e->timer_fifo.wr_proc, pos);
+		}
+		// place new_compare here at pos
+		e->timer_compare[pos] = new_compare;
+		e->timer_ctrl[pos] = EV_TIMER_CTRL_ACTIVE;
+		e->timer_event[pos].data = ev->data;
+		e->timer_event[pos].tid  = ev->tid;
+		e->timer_event[pos].event  = ev->event;
+	}
+    fifo_finalize_append(&e->timer_fifo);
+	if(events_compare_times(new_compare, e->timer_CNT) <= 0) {
+		// already due, it is sorted in among the collected due timer events
+		e->timer_due++;
+	}
+	events_print_timer_events(e);
+	// get first compare value
+	get_compare_from_timer_event_fifo(e);
+
+    restore_interrupt(sr);
+	return true;
+}
+
+// - staged timer events -------------------------------------------------------
+// ISRs push arm/cancel requests into a lock-free ring (1 compare and swap),
+// the scheduler sorts them into the timer events, see events_ctx_merge_staged_timer_events()
+
+/**
+ * push a timer request into the stage ring, multi producer safe
+ * @param	op		EV_TIMER_STAGE_ARM, _ARM_AT, _CANCEL
+ * @param	time	timeout or deadline in ticks, depends on op
+ * @param	ev		event of the request
+ * @return	=true: OK, request is staged, =false: error, the stage ring is full
+ */
+static int8_t events_timer_stage_push(events_ctx_t *e, uint8_t op, uint64_t time, event_t *ev) {
+	events_timer_stage_t *s;
+	uint16_t pos;
+	int16_t diff;
+
+	pos = atomic_load_explicit(&e->timer_stage_wr, memory_order_relaxed);
+	while(1) {
+		s = &e->timer_stage[pos & (EV_TIMER_STAGE_SIZE - 1)];
+		diff = (int16_t)(atomic_load_explicit(&s->seq, memory_order_acquire) - pos);
+		if(diff == 0) {
+			// slot is free, claim it
+			if(atomic_compare_exchange_weak_explicit(&e->timer_stage_wr, &pos, (uint16_t)(pos + 1),
+					memory_order_relaxed, memory_order_relaxed)) {
+				break;
+			}
+			// another producer was faster, pos is reloaded
+		}
+		else if(diff < 0) {
+			// not yet merged, the stage ring is full
+			return false;
+		}
+		else {
+			pos = atomic_load_explicit(&e->timer_stage_wr, memory_order_relaxed);
+		}
+	}
+	s->op = op;
+	s->time = time;
+	s->ev = *ev;
+	// publish the request to the scheduler
+	atomic_store_explicit(&s->seq, (uint16_t)(pos + 1), memory_order_release);
+	// a sleeping scheduler merges it now, not on the next unrelated event
+	events_ext_ctx_wake(&e->sched->ext);
+	return true;
+}
+
+int8_t events_ctx_stage_single_timer_event(events_ctx_t *e, uint32_t timeout, event_t *ev) {
+	if((ev == NULL) || (timeout == 0)) {
+		return false;
+	}
+	return events_timer_stage_push(e, EV_TIMER_STAGE_ARM, timeout, ev);
+}
+
+int8_t events_ctx_stage_single_timer_event_at(events_ctx_t *e, uint64_t deadline, event_t *ev) {
+	if(ev == NULL) {
+		return false;
+	}
+	return events_timer_stage_push(e, EV_TIMER_STAGE_ARM_AT, deadline, ev);
+}
+
+int8_t events_ctx_stage_cancel_timer_events(events_ctx_t *e, uint8_t tid, uint8_t event) {
+	event_t ev;
+	ev.data = EVENT_DATA_PACK(NULL);
+	ev.tid = tid;
+	ev.event = event;
+	ev.flags = 0;
+	return events_timer_stage_push(e, EV_TIMER_STAGE_CANCEL, 0, &ev);
+}
+
+/**
+ * a staged timer event did not fit into the timer events, the ISR already saw it accepted
+ */
+static void events_timer_stage_lost(events_ctx_t *e) {
+	uint16_t sr;
+	lock_interrupt(sr);
+	e->timer_stats.staged_lost++;
+	restore_interrupt(sr);
+	DLOG_WARN("events_merge_staged_timer_events(): no more timer events, staged timer event lost\n");
+}
+
+uint16_t events_ctx_merge_staged_timer_events(events_ctx_t *e) {
+	events_timer_stage_t *s;
+	uint16_t cnt = 0;
+
+	while(1) {
+		s = &e->timer_stage[e->timer_stage_rd & (EV_TIMER_STAGE_SIZE - 1)];
+		if(atomic_load_explicit(&s->seq, memory_order_acquire) != (uint16_t)(e->timer_stage_rd + 1)) {
+			// no more staged requests
+			break;
+		}
+		// recorded here, in the scheduler thread, in the order it merges them, a lost arm is not recorded
+		switch(s->op) {
+		case EV_TIMER_STAGE_ARM:
+			if(events_ctx_add_single_timer_event(e, (uint32_t)s->time, &s->ev) == false) {
+				events_timer_stage_lost(e);
 				break;
 			}
-			if(pos_timeout > timeout) {
-				DEBUG_PRINTF_MESSAGE("   pos_timeout > timeout, so @pos will come later, make space for new timeout\n");
-				// current current_compare(@pos) > new_compare
-				// make space for new_compare at pos
-				events_move_elements_in_timer_fifo_right(events_timer_fifo.wr_proc, pos);
+			replay_ctx_record_staged(e->sched, REPLAY_ARM, s->ev.tid, s->ev.event, EVENT_DATA_UNPACK(s->ev.data), s->time);
+			break;
+		case EV_TIMER_STAGE_ARM_AT:
+			if(events_ctx_add_single_timer_event_at(e, s->time, &s->ev) == false) {
+				events_timer_stage_lost(e);
 				break;
 			}
+			replay_ctx_record_staged(e->sched, REPLAY_ARM_AT, s->ev.tid, s->ev.event, EVENT_DATA_UNPACK(s->ev.data), s->time);
+			break;
+		case EV_TIMER_STAGE_CANCEL:
+			replay_ctx_record_staged(e->sched, REPLAY_CANCEL, s->ev.tid, s->ev.event, NULL, 0);
+			events_ctx_cancel_timer_events(e, s->ev.tid, s->ev.event);
+			break;
 		}
-		// place new_compare here at pos
-		events_timer_fifo_data[pos].compare = new_compare;
-		events_timer_fifo_data[pos].ctrl = EV_TIMER_CTRL_ACTIVE;
-		events_timer_fifo_data[pos].event.data = ev->data;
-		events_timer_fifo_data[pos].event.tid  = ev->tid;
-		events_timer_fifo_data[pos].event.event  = ev->event;
+		// free the slot for the next round of the ring
+		atomic_store_explicit(&s->seq, (uint16_t)(e->timer_stage_rd + EV_TIMER_STAGE_SIZE), memory_order_release);
+		e->timer_stage_rd++;
+		cnt++;
 	}
-    fifo_finalize_append(&events_timer_fifo);
-	DEBUG_PRINTF_MESSAGE(" event: tid: %d, event: %d, data: %p (wr: %d, rd:%d, size: %d)\n",
-				ev->tid, ev->event, ev->data, events_timer_fifo.wr, events_timer_fifo.rd, events_timer_fifo.size);
+	return cnt;
+}
 
-	events_print_timer_events();
-	// get first compare value
-	get_compare_from_timer_event_fifo();
+uint8_t events_ctx_is_timer_stage_pending(events_ctx_t *e) {
+	// a claimed slot counts, its request is on the way
+	return (atomic_load_explicit(&e->timer_stage_wr, memory_order_relaxed) != e->timer_stage_rd);
+}
 
-    restore_interrupt(sr);
-	return true;
+// - default instance ----------------------------------------------------------
+// the events of the scheduler instance that runs in this thread (default: scheduler_get_default_ctx())
+#define events_ctx() (&scheduler_get_ctx()->events)
+
+void events_init(void) {
+	events_ctx_init(&scheduler_get_default_ctx()->events, scheduler_get_default_ctx());
+}
+
+uint8_t events_add_to_main_fifo(event_t *ev) {
+	return events_ctx_add_to_main_fifo(events_ctx(), ev);
+}
+
+uint8_t events_get_from_main_fifo(event_t *ev) {
+	return events_ctx_get_from_main_fifo(events_ctx(), ev);
+}
+
+uint8_t events_is_main_fifo_empty(void) {
+	return events_ctx_is_main_fifo_empty(events_ctx());
+}
+
+uint8_t events_peek_main_fifo(event_t *ev) {
+	return events_ctx_peek_main_fifo(events_ctx(), ev);
+}
+
+uint16_t events_purge_main_fifo(uint8_t tid) {
+	return events_ctx_purge_main_fifo(events_ctx(), tid);
+}
+
+uint16_t events_take_from_main_fifo(uint8_t tid, event_t *evs, uint16_t max) {
+	return events_ctx_take_from_main_fifo(events_ctx(), tid, evs, max);
+}
+
+uint8_t events_add_to_group_fifo(uint8_t group, event_t *ev) {
+	return events_ctx_add_to_group_fifo(events_ctx(), group, ev);
+}
+
+uint8_t events_get_from_group_fifo(uint8_t group, event_t *ev) {
+	return events_ctx_get_from_group_fifo(events_ctx(), group, ev);
+}
+
+uint8_t events_is_group_fifo_empty(uint8_t group) {
+	return events_ctx_is_group_fifo_empty(events_ctx(), group);
+}
+
+uint16_t events_take_from_group_fifo(uint8_t group, uint8_t tid, event_t *evs, uint16_t max) {
+	return events_ctx_take_from_group_fifo(events_ctx(), group, tid, evs, max);
+}
+
+int8_t events_start_timer(uint16_t periode) {
+	return events_ctx_start_timer(events_ctx(), periode);
+}
+
+int8_t events_stop_timer(void) {
+	return events_ctx_stop_timer(events_ctx());
+}
+
+void events_timer_tick(uint32_t ticks) {
+	events_ctx_timer_tick(events_ctx(), ticks);
+}
+
+void events_timer_poll(void) {
+	events_ctx_timer_poll(events_ctx());
+}
+
+uint8_t events_get_due_timer_event(event_t *ev) {
+	return events_ctx_get_due_timer_event(events_ctx(), ev);
+}
+
+uint8_t events_peek_timer_event(event_t *ev) {
+	return events_ctx_peek_timer_event(events_ctx(), ev);
+}
+
+uint16_t events_purge_timer_events(uint8_t tid) {
+	return events_ctx_purge_timer_events(events_ctx(), tid);
+}
+
+uint16_t events_cancel_timer_events(uint8_t tid, uint8_t event) {
+	return events_ctx_cancel_timer_events(events_ctx(), tid, event);
+}
+
+int8_t events_stage_single_timer_event(uint32_t timeout, event_t *ev) {
+	return events_ctx_stage_single_timer_event(events_ctx(), timeout, ev);
+}
+
+int8_t events_stage_single_timer_event_at(uint64_t deadline, event_t *ev) {
+	return events_ctx_stage_single_timer_event_at(events_ctx(), deadline, ev);
+}
+
+int8_t events_stage_cancel_timer_events(uint8_t tid, uint8_t event) {
+	return events_ctx_stage_cancel_timer_events(events_ctx(), tid, event);
+}
+
+uint16_t events_merge_staged_timer_events(void) {
+	return events_ctx_merge_staged_timer_events(events_ctx());
+}
+
+uint8_t events_is_timer_stage_pending(void) {
+	return events_ctx_is_timer_stage_pending(events_ctx());
+}
+
+int8_t events_timer_next_deadline(uint64_t *deadline) {
+	return events_ctx_timer_next_deadline(events_ctx(), deadline);
+}
+
+int8_t events_get_timer_stats(events_timer_stats_t *stats) {
+	return events_ctx_get_timer_stats(events_ctx(), stats);
+}
+
+void events_reset_timer_stats(void) {
+	events_ctx_reset_timer_stats(events_ctx());
+}
+
+uint64_t events_get_time_ticks(void) {
+	return events_ctx_get_time_ticks(events_ctx());
+}
+
+uint64_t events_get_time_ns(void) {
+	return events_ctx_get_time_ns(events_ctx());
+}
+
+uint64_t events_get_clock_ticks(void) {
+	return events_ctx_get_clock_ticks(events_ctx());
+}
+
+uint64_t events_get_clock_ns(void) {
+	return events_ctx_get_clock_ns(events_ctx());
+}
+
+int8_t events_add_single_timer_event(uint32_t timeout, event_t *ev) {
+	return events_ctx_add_single_timer_event(events_ctx(), timeout, ev);
+}
+
+int8_t events_add_single_timer_event_at(uint64_t deadline, event_t *ev) {
+	return events_ctx_add_single_timer_event_at(events_ctx(), deadline, ev);
 }
@@ -11,15 +11,123 @@
 //- includes -------------------------------------------------------------------
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 #include "arch.h"
 #include "fifo.h"
+#include "task.h"
+
+//- defines --------------------------------------------------------------------
+// tick rate of the event timer, all timeouts are given in ticks
+#ifndef EV_TIMER_TICK_HZ
+#define EV_TIMER_TICK_HZ (1000ull)
+#endif
+// define EV_TIMER_HOST_CLOCK to drive the event timer from the monotonic
+// clock of the host (clock_gettime()) instead of counting ticks
+// define EVENTS_COMPACT for the compact event_t layout, see event_data_t
+// define EVENTS_LATENCY_ON to stamp the events, see scheduler_get_task_latency()
+#define EVENTS_MAIN_FIFO_SIZE (32) /// number of events in event main_fifo
+// event groups: every group has its own fifo, group 0 is the main_fifo, see scheduler_set_task_group()
+#ifndef EVENTS_NB_OF_GROUPS
+#define EVENTS_NB_OF_GROUPS (4) /// 2 ... 255
+#endif
+#ifndef EVENTS_GROUP_FIFO_SIZE
+#define EVENTS_GROUP_FIFO_SIZE (16) /// number of events in the fifo of group 1, 2, ...
+#endif
+#ifndef EV_TIMER_NB_EVENTS
+#define EV_TIMER_NB_EVENTS  (32) /// number of pending timer events, max. 65535
+#endif
+#ifndef EV_TIMER_STAGE_SIZE
+#define EV_TIMER_STAGE_SIZE (16) /// number of staged timer requests (from ISRs), must be a power of 2
+#endif
 
 //- typedefs -------------------------------------------------------------------
-typedef struct {
-  void * data;
+#ifdef EVENTS_COMPACT
+// compact layout: the data of an event is a 32 bit payload handle or index,
+// event_t takes 8 instead of 16 bytes on 64 bit hosts, pointers only if they fit into 32 bit
+// (EVENT_DATA_PACK() truncates, check with EVENT_DATA_FITS())
+typedef uint32_t event_data_t;
+#define EVENT_DATA_PACK(p)      ((event_data_t)(uintptr_t)(p))
+#define EVENT_DATA_UNPACK(d)    ((void *)(uintptr_t)(d))
+#define EVENT_DATA_FITS(p)      ((uintptr_t)(p) <= UINT32_MAX)
+#else
+typedef void * event_data_t;
+#define EVENT_DATA_PACK(p)      (p)
+#define EVENT_DATA_UNPACK(d)    (d)
+#define EVENT_DATA_FITS(p)      (true)
+#endif
+
+typedef struct event_s {
+  event_data_t data;  /// use EVENT_DATA_PACK(), EVENT_DATA_UNPACK()
   uint8_t tid;
   uint8_t event;
+  uint8_t flags;
+#ifdef EVENTS_LATENCY_ON
+  uint32_t stamp;     /// time in ns (lower 32 bit) it was queued or became due, see scheduler_get_task_latency()
+#endif
 } event_t;
+// .flags
+#define EV_FLAG_COALESCED (1<<0) /// data and count are held by the scheduler, see scheduler_send_event_coalesced()
+
+/**
+ * statistics of the event timer, how many timer events expired and how late
+ * lateness is counted in ticks: ev_timer_CNT - compare at expiry
+ */
+typedef struct {
+  uint32_t expired;       /// number of expired timer events
+  uint32_t late;          /// number of timer events expired after their compare value
+  uint64_t lateness_max;  /// maximum lateness in ticks
+  uint64_t lateness_sum;  /// sum of all lateness in ticks (average = lateness_sum / late)
+  uint32_t staged_lost;   /// staged timer events (from ISRs) that did not fit into the timer events when merged
+} events_timer_stats_t;
+
+// .timer_ctrl of events_ctx_t
+#define EV_TIMER_CTRL_ACTIVE (1<<0)
+
+/**
+ * timer request from an ISR, staged in a lock-free ring (multi producer,
+ * single consumer) until the scheduler merges it into the timer events
+ * seq: =pos: slot is free for position pos, =pos + 1: request is written
+ */
+typedef struct {
+  _Atomic uint16_t seq;
+  uint8_t op;
+  uint64_t time;  /// timeout or deadline in ticks, depends on op
+  event_t ev;
+} events_timer_stage_t;
+// .op
+#define EV_TIMER_STAGE_ARM    (1) /// add ev, time: timeout after the merge
+#define EV_TIMER_STAGE_ARM_AT (2) /// add ev, time: absolute deadline
+#define EV_TIMER_STAGE_CANCEL (3) /// cancel the timer events ev.tid, ev.event
+
+struct scheduler_ctx_s;
+/**
+ * events of 1 scheduler instance: main_fifo, timer events and time base
+ * embedded in scheduler_ctx_t, do not access the members directly
+ */
+typedef struct {
+  fifo_t main_fifo;
+  event_t main_fifo_data[EVENTS_MAIN_FIFO_SIZE];
+  fifo_t group_fifo[EVENTS_NB_OF_GROUPS - 1];  /// group 1, 2, ...
+  event_t group_fifo_data[EVENTS_NB_OF_GROUPS - 1][EVENTS_GROUP_FIFO_SIZE];
+  fifo_t timer_fifo;              /// sorted timer events, stored as arrays (SoA), no padding
+  uint64_t timer_compare[EV_TIMER_NB_EVENTS];
+  event_t timer_event[EV_TIMER_NB_EVENTS];
+  uint8_t timer_ctrl[EV_TIMER_NB_EVENTS];
+  task_t timer_proc;              /// event timer task
+  uint64_t timer_CNT;             /// current time in ticks
+  uint64_t timer_COMPARE;         /// compare of the 1st timer event, valid if timer_fifo is not empty
+  uint32_t timer_ticks_pending;   /// ticks not yet processed by the event timer task
+  uint8_t timer_tick_posted;      /// =true: EV_POLL to the event timer task is in the main_fifo
+  uint16_t timer_due;             /// number of due timer events (compare <= CNT) at the start of timer_fifo
+  events_timer_stats_t timer_stats;
+  events_timer_stage_t timer_stage[EV_TIMER_STAGE_SIZE];
+  _Atomic uint16_t timer_stage_wr; /// runs freely, position = wr & (EV_TIMER_STAGE_SIZE - 1)
+  uint16_t timer_stage_rd;         /// read by the scheduler only
+#ifdef EV_TIMER_HOST_CLOCK
+  uint64_t host_clock_start_ns;
+#endif
+  struct scheduler_ctx_s *sched;  /// scheduler instance these events belong to
+} events_ctx_t;
 
 // - events --------------------------------------------------------------------
 // events from 0 ... 250 are for user purpose
@@ -27,11 +135,15 @@ typedef struct {
 #define EV_START   250
 #define EV_STOP    251
 #define EV_POLL    252
+#define EV_IDLE    253 /// idle task: do a slice of background work
+#define EV_ANY     255 /// matches every event, see events_cancel_timer_events()
 
 // - public functions ----------------------------------------------------------
 
 /**
  * initialize the events
+ * the events_*() functions use the scheduler instance that runs in the
+ * calling thread, or the default instance, see scheduler_get_ctx()
  */
 void events_init(void);
 
@@ -52,12 +164,72 @@ uint8_t events_add_to_main_fifo(event_t *ev);
 uint8_t events_get_from_main_fifo(event_t *ev);
 
 /**
- * check if event main_fifo is empty
+ * check if event main_fifo is empty, and the fifos of all event groups
  * @return  =true: event main_fifo is empty
  *          =false: event main_fifo is NOT empty
  */
 uint8_t events_is_main_fifo_empty(void);
 
+/**
+ * get the next event of the event main_fifo (or of the 1st event group with
+ * events) without removing it, e.g. to see what woke up the scheduler
+ * @param   ev      pointer to copy the event to
+ * @return  =true: OK, ev is valid
+ *          =false: all fifos are empty
+ */
+uint8_t events_peek_main_fifo(event_t *ev);
+
+/**
+ * write an event to the fifo of an event group
+ * @param   group   event group, =0: main_fifo
+ * @param   event   pointer to event to put into the fifo
+ * @return  =true: OK, writing event successfull
+ *          =false: Error, could not write, no such group or its fifo is full
+ */
+uint8_t events_add_to_group_fifo(uint8_t group, event_t *ev);
+
+/**
+ * read an event from the fifo of an event group
+ * @param   group   event group, =0: main_fifo
+ * @param   event   pointer to event to read
+ * @return  =true: OK, reading event successfull, event is valid
+ *          =false: Error, could not read, no such group or its fifo is empty
+ */
+uint8_t events_get_from_group_fifo(uint8_t group, event_t *ev);
+
+/**
+ * check if the fifo of an event group is empty
+ * @param   group   event group, =0: main_fifo
+ * @return  =true: fifo is empty (or no such group)
+ *          =false: fifo is NOT empty
+ */
+uint8_t events_is_group_fifo_empty(uint8_t group);
+
+/**
+ * remove all events of a task from the event main_fifo (and all event groups)
+ * the order of the remaining events is kept
+ * @param   tid     task identifier
+ * @return  number of removed events
+ */
+uint16_t events_purge_main_fifo(uint8_t tid);
+
+/**
+ * take the events of a task out of the event main_fifo (and all event groups)
+ * the order of the taken and of the remaining events is kept
+ * @param   tid     task identifier
+ * @param   evs     array to copy the events to, =NULL: only remove them
+ * @param   max     number of events to take at most
+ * @return  number of taken events
+ */
+uint16_t events_take_from_main_fifo(uint8_t tid, event_t *evs, uint16_t max);
+
+/**
+ * take the events of a task out of the fifo of an event group
+ * see events_take_from_main_fifo()
+ * @param   group   event group, =0: main_fifo
+ */
+uint16_t events_take_from_group_fifo(uint8_t group, uint8_t tid, event_t *evs, uint16_t max);
+
 // - timing events -------------------------------------------------------------
 
 /**
@@ -75,13 +247,221 @@ int8_t events_start_timer(uint16_t periode);
  */
 int8_t events_stop_timer(void);
 
+/**
+ * advance the event timer by a number of ticks
+ * call this from the hardware timer ISR (or the host port), ticks that could
+ * not be processed in time are accumulated, the event timer task catches up
+ * and expires all due timer events in one pass
+ * @param   ticks   elapsed since the last call
+ */
+void events_timer_tick(uint32_t ticks);
+
+/**
+ * host port (EV_TIMER_HOST_CLOCK): check the clock and send a tick to the
+ * event timer task if the next timer event is due, call this while idle
+ * does nothing if EV_TIMER_HOST_CLOCK is not defined
+ */
+void events_timer_poll(void);
+
+/**
+ * get the deadline of the next timer event
+ * @param   deadline    pointer to store the deadline (in ticks), =NULL: only check
+ * @return  =true: there is a pending timer event
+ *          =false: no pending timer events
+ */
+int8_t events_timer_next_deadline(uint64_t *deadline);
+
+/**
+ * get the next due timer event, in deadline order
+ * due timer events are not sent through the main_fifo, the event timer task
+ * collects them and the scheduler dispatches them straight from the timer
+ * events, this cannot fail with a full main_fifo
+ * call from the scheduler only
+ * @param   ev      pointer to store the due timer event
+ * @return  =true: OK, ev is valid
+ *          =false: no due timer events
+ */
+uint8_t events_get_due_timer_event(event_t *ev);
+
+/**
+ * get the pending timer event with the earliest deadline, without removing it
+ * @param   ev      pointer to copy the timer event to
+ * @return  =true: OK, ev is valid
+ *          =false: no pending timer events
+ */
+uint8_t events_peek_timer_event(event_t *ev);
+
+/**
+ * remove all pending timer events of a task
+ * @param   tid     task identifier
+ * @return  number of removed timer events
+ */
+uint16_t events_purge_timer_events(uint8_t tid);
+
+/**
+ * cancel the pending timer events of a task
+ * @param   tid     task identifier
+ * @param   event   event to cancel, =EV_ANY: all timer events of the task
+ * @return  number of canceled timer events
+ */
+uint16_t events_cancel_timer_events(uint8_t tid, uint8_t event);
+
+/**
+ * stage a single timer event, from an ISR (or any other context)
+ * lock-free, does not sort the timer event in, the scheduler merges it into
+ * the timer events before it dispatches the next event
+ * @param   timeout after which to send the event, in ticks, counted from the merge
+ * @param   event   pointer to event to stage
+ * @return	status 	=true: OK, timer event is staged
+ *					=false: error, timeout = 0 or the stage ring is full
+ */
+int8_t events_stage_single_timer_event(uint32_t timeout, event_t *ev);
+
+/**
+ * stage a single timer event at an absolute deadline, see events_stage_single_timer_event()
+ * @param   deadline    time in ticks (see events_get_time_ticks()) at which to send the event
+ * @param   event   pointer to event to stage
+ * @return	status 	=true: OK, timer event is staged
+ *					=false: error, the stage ring is full
+ */
+int8_t events_stage_single_timer_event_at(uint64_t deadline, event_t *ev);
+
+/**
+ * stage canceling the timer events of a task, from an ISR (or any other context)
+ * lock-free, applied in order with the staged timer events, see events_cancel_timer_events()
+ * @param   tid     task identifier
+ * @param   event   event to cancel, =EV_ANY: all timer events of the task
+ * @return	status 	=true: OK, cancel is staged
+ *					=false: error, the stage ring is full
+ */
+int8_t events_stage_cancel_timer_events(uint8_t tid, uint8_t event);
+
+/**
+ * merge the staged timer requests into the timer events, in the order they were staged
+ * call from the scheduler only (single consumer)
+ * @return  number of merged requests
+ */
+uint16_t events_merge_staged_timer_events(void);
+
+/**
+ * check if timer requests are staged (or being staged) and not yet merged
+ * @return  =true: there are staged timer requests
+ */
+uint8_t events_is_timer_stage_pending(void);
+
+/**
+ * read the statistics of the event timer
+ * @param   stats   pointer to copy the statistics to
+ * @return  =true: OK, =false: error, stats == NULL
+ */
+int8_t events_get_timer_stats(events_timer_stats_t *stats);
+
+/**
+ * reset the statistics of the event timer
+ */
+void events_reset_timer_stats(void);
+
+/**
+ * get the current time of the event timer (64 bit, monotonic)
+ * @return  time in ticks since events_init()
+ */
+uint64_t events_get_time_ticks(void);
+
+/**
+ * get the current time of the event timer (64 bit, monotonic)
+ * with EV_TIMER_HOST_CLOCK in full clock resolution, else in tick resolution
+ * @return  time in ns since events_init()
+ */
+uint64_t events_get_time_ns(void);
+
+/**
+ * get the current time of the clock that drives the event timer, also counts
+ * the ticks the timer task has not yet processed (events_get_time_ticks() does
+ * not), e.g. to measure time while the timer task cannot run (sleep)
+ * @return  time in ticks since events_init()
+ */
+uint64_t events_get_clock_ticks(void);
+
+/**
+ * get the current time of the clock that drives the event timer, see events_get_clock_ticks()
+ * with EV_TIMER_HOST_CLOCK in full clock resolution, else in tick resolution
+ * @return  time in ns since events_init()
+ */
+uint64_t events_get_clock_ns(void);
+
+/**
+ * convert ticks to ns, using EV_TIMER_TICK_HZ
+ * @param   ticks   to convert
+ * @return  ns
+ */
+uint64_t events_ticks_to_ns(uint64_t ticks);
+
+/**
+ * convert ns to ticks (rounded down), using EV_TIMER_TICK_HZ
+ * @param   ns      to convert
+ * @return  ticks
+ */
+uint64_t events_ns_to_ticks(uint64_t ns);
+
 /**
  * add a single event to the event timer
- * @param   timeout after which to send the event
+ * @param   timeout after which to send the event, in ticks
  * @param   event   pointer to event to put into ev_main_fifo_data
  * @return	status 	=true: OK, could add event
  *					=false: error, could not add event
  */
-int8_t events_add_single_timer_event(uint16_t timeout, event_t *ev);
+int8_t events_add_single_timer_event(uint32_t timeout, event_t *ev);
+
+/**
+ * add a single event to the event timer at an absolute deadline
+ * a deadline in the past is dispatched right away
+ * @param   deadline    time in ticks (see events_get_time_ticks()) at which to send the event
+ * @param   event   pointer to event to put into ev_main_fifo_data
+ * @return	status 	=true: OK, could add event
+ *					=false: error, could not add event
+ */
+int8_t events_add_single_timer_event_at(uint64_t deadline, event_t *ev);
+
+// - scheduler instances -------------------------------------------------------
+// same as the functions above, on the events of a given scheduler instance
+
+/**
+ * initialize the events of a scheduler instance, adds its event timer task
+ * @param   e       events to initialize
+ * @param   sched   scheduler instance these events belong to
+ */
+void events_ctx_init(events_ctx_t *e, struct scheduler_ctx_s *sched);
+uint8_t events_ctx_add_to_main_fifo(events_ctx_t *e, event_t *ev);
+uint8_t events_ctx_get_from_main_fifo(events_ctx_t *e, event_t *ev);
+uint8_t events_ctx_is_main_fifo_empty(events_ctx_t *e);
+uint8_t events_ctx_peek_main_fifo(events_ctx_t *e, event_t *ev);
+uint16_t events_ctx_purge_main_fifo(events_ctx_t *e, uint8_t tid);
+uint16_t events_ctx_take_from_main_fifo(events_ctx_t *e, uint8_t tid, event_t *evs, uint16_t max);
+uint8_t events_ctx_add_to_group_fifo(events_ctx_t *e, uint8_t group, event_t *ev);
+uint8_t events_ctx_get_from_group_fifo(events_ctx_t *e, uint8_t group, event_t *ev);
+uint8_t events_ctx_is_group_fifo_empty(events_ctx_t *e, uint8_t group);
+uint16_t events_ctx_take_from_group_fifo(events_ctx_t *e, uint8_t group, uint8_t tid, event_t *evs, uint16_t max);
+int8_t events_ctx_start_timer(events_ctx_t *e, uint16_t periode);
+int8_t events_ctx_stop_timer(events_ctx_t *e);
+void events_ctx_timer_tick(events_ctx_t *e, uint32_t ticks);
+void events_ctx_timer_poll(events_ctx_t *e);
+int8_t events_ctx_timer_next_deadline(events_ctx_t *e, uint64_t *deadline);
+uint8_t events_ctx_get_due_timer_event(events_ctx_t *e, event_t *ev);
+uint8_t events_ctx_peek_timer_event(events_ctx_t *e, event_t *ev);
+uint16_t events_ctx_purge_timer_events(events_ctx_t *e, uint8_t tid);
+uint16_t events_ctx_cancel_timer_events(events_ctx_t *e, uint8_t tid, uint8_t event);
+int8_t events_ctx_stage_single_timer_event(events_ctx_t *e, uint32_t timeout, event_t *ev);
+int8_t events_ctx_stage_single_timer_event_at(events_ctx_t *e, uint64_t deadline, event_t *ev);
+int8_t events_ctx_stage_cancel_timer_events(events_ctx_t *e, uint8_t tid, uint8_t event);
+uint16_t events_ctx_merge_staged_timer_events(events_ctx_t *e);
+uint8_t events_ctx_is_timer_stage_pending(events_ctx_t *e);
+int8_t events_ctx_get_timer_stats(events_ctx_t *e, events_timer_stats_t *stats);
+void events_ctx_reset_timer_stats(events_ctx_t *e);
+uint64_t events_ctx_get_time_ticks(events_ctx_t *e);
+uint64_t events_ctx_get_time_ns(events_ctx_t *e);
+uint64_t events_ctx_get_clock_ticks(events_ctx_t *e);
+uint64_t events_ctx_get_clock_ns(events_ctx_t *e);
+int8_t events_ctx_add_single_timer_event(events_ctx_t *e, uint32_t timeout, event_t *ev);
+int8_t events_ctx_add_single_timer_event_at(events_ctx_t *e, uint64_t deadline, event_t *ev);
 
 #endif // _EVENTS_H_
@@ -0,0 +1,393 @@
+/**
+ * Martin Egli
+ * 2024-10-12
+ * external events: post events into the scheduler from POSIX threads,
+ * signal handlers and other non-scheduler contexts (host port)
+ * coop scheduler for mcu
+ */
+
+// - includes ------------------------------------------------------------------
+#define _GNU_SOURCE // ppoll()
+//#define DEBUG_PRINTF_ON
+#include "debug_printf.h"
+
+#include "events_ext.h"
+
+#ifdef EVENTS_EXT_ON
+#include <stdatomic.h>
+#include <string.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "scheduler.h"
+#include "events_shm.h"
+
+#if (EVENTS_EXT_RING_SIZE & (EVENTS_EXT_RING_SIZE - 1)) != 0
+#error "EVENTS_EXT_RING_SIZE must be a power of 2"
+#endif
+#if EVENTS_EXT_NB_OF_PRODUCERS > 31
+#error "EVENTS_EXT_NB_OF_PRODUCERS > 31, does not fit into events_ext_ctx_t.pending"
+#endif
+// bit in events_ext_ctx_t.pending: something else was staged, see events_ext_ctx_wake()
+#define EVENTS_EXT_PENDING_WAKE (1u << 31)
+
+// - private functions ---------------------------------------------------------
+static uint64_t events_ext_clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * note the time of the 1st ring of the doorbell, for the wakeup latency
+ * clock_gettime() is async-signal-safe
+ */
+static inline void events_ext_note_ring(_Atomic uint64_t *ring_ns) {
+    uint64_t none = 0;
+    if(atomic_load_explicit(ring_ns, memory_order_relaxed) == 0) {
+        atomic_compare_exchange_strong(ring_ns, &none, events_ext_clock_ns());
+    }
+}
+
+/**
+ * wake up the scheduler if it sleeps, call after setting pending
+ * async-signal-safe
+ */
+static void events_ext_ring_doorbell(events_ext_ctx_t *x) {
+    uint64_t one = 1;
+    if(atomic_load(&x->sleeping)) {
+        if(x->futex != NULL) {
+            // the scheduler waits on the futex doorbell, see events_shm.h
+            events_ext_note_ring(&x->futex->ring_ns);
+            atomic_fetch_add(&x->futex->seq, 1);
+            syscall(SYS_futex, &x->futex->seq, FUTEX_WAKE, 1, NULL, NULL, 0);
+        }
+        else {
+            // ring the doorbell, write() is async-signal-safe
+            events_ext_note_ring(&x->ring_ns);
+            if(write(x->doorbell, &one, sizeof(one)) < 0) {
+                // counter is already set, the scheduler wakes up anyway
+            }
+        }
+    }
+}
+
+static inline uint8_t events_ext_any_pending(events_ext_ctx_t *x) {
+    return (atomic_load(&x->pending) != 0) || ((x->futex != NULL) && (atomic_load(&x->futex->pending) != 0));
+}
+
+/**
+ * end of an idle period, adapt the spin window to the idle gaps
+ * @param   now     time in ns
+ * @param   arrived =true: ended by an external event, =false: by a timer event
+ */
+static void events_ext_idle_end(events_ext_ctx_t *x, uint64_t now, uint8_t arrived) {
+    events_ext_idle_stats_t *st = &x->idle_stats;
+    uint64_t gap;
+
+    if(arrived) {
+        // a long idle gap counts as long, but does not hide the next burst for long
+        gap = now - x->idle_start_ns;
+        if(gap > 4ull * x->spin_max_ns) {
+            gap = 4ull * x->spin_max_ns;
+        }
+        // moving average, 1/8 weight of the latest gap
+        st->idle_gap_ns = st->idle_gap_ns - st->idle_gap_ns / 8 + (uint32_t)(gap / 8);
+        if(st->idle_gap_ns > x->spin_max_ns) {
+            // events arrive too slowly, do not burn the core
+            st->spin_window_ns = 0;
+        }
+        else {
+            st->spin_window_ns = (2 * st->idle_gap_ns < x->spin_max_ns) ? (2 * st->idle_gap_ns) : x->spin_max_ns;
+        }
+    }
+    x->idle_start_ns = 0;
+}
+
+// - public functions ----------------------------------------------------------
+void events_ext_ctx_init(events_ext_ctx_t *x, struct scheduler_ctx_s *sched) {
+    uint8_t n;
+    for(n = 0; n < EVENTS_EXT_NB_OF_PRODUCERS; n++) {
+        atomic_store(&x->rings[n].wr, 0);
+        atomic_store(&x->rings[n].rd, 0);
+    }
+    atomic_store(&x->producer_count, 0);
+    atomic_store(&x->pending, 0);
+    atomic_store(&x->sleeping, 0);
+    atomic_store(&x->dropped, 0);
+    // close it before a re-init, see events_ext_ctx_destroy()
+    x->doorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    x->futex = NULL;
+    atomic_store(&x->ring_ns, 0);
+    x->idle_start_ns = 0;
+    // on a single cpu spinning only delays the sender
+    x->spin_max_ns = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? EVENTS_EXT_SPIN_MAX_NS : 0;
+    memset(&x->idle_stats, 0, sizeof(x->idle_stats));
+    x->sched = sched;
+}
+
+void events_ext_ctx_destroy(events_ext_ctx_t *x) {
+    if(x->doorbell >= 0) {
+        close(x->doorbell);
+        x->doorbell = -1;
+    }
+    x->futex = NULL;
+}
+
+uint8_t events_ext_ctx_register_producer(events_ext_ctx_t *x) {
+    unsigned int id = atomic_fetch_add(&x->producer_count, 1);
+    if(id >= EVENTS_EXT_NB_OF_PRODUCERS) {
+        // error, no more producers
+        return EVENTS_EXT_NO_PRODUCER;
+    }
+    return (uint8_t)id;
+}
+
+int8_t events_ext_ctx_send(events_ext_ctx_t *x, uint8_t producer, uint8_t tid, uint8_t event, void *data) {
+    ext_ring_t *r;
+    uint16_t wr, rd;
+
+    if(producer >= EVENTS_EXT_NB_OF_PRODUCERS) {
+        // error, invalid producer
+        return false;
+    }
+    r = &x->rings[producer];
+    wr = atomic_load_explicit(&r->wr, memory_order_relaxed);
+    rd = atomic_load_explicit(&r->rd, memory_order_acquire);
+    if((uint16_t)(wr - rd) >= EVENTS_EXT_RING_SIZE) {
+        // error, ring is full
+        atomic_fetch_add_explicit(&x->dropped, 1, memory_order_relaxed);
+        return false;
+    }
+    r->data[wr & (EVENTS_EXT_RING_SIZE - 1)].tid = tid;
+    r->data[wr & (EVENTS_EXT_RING_SIZE - 1)].event = event;
+    r->data[wr & (EVENTS_EXT_RING_SIZE - 1)].data = EVENT_DATA_PACK(data);
+    r->data[wr & (EVENTS_EXT_RING_SIZE - 1)].flags = 0;
+    atomic_store_explicit(&r->wr, (uint16_t)(wr + 1), memory_order_release);
+
+    // pending before checking sleeping, pairs with events_ext_sleep()
+    atomic_fetch_or(&x->pending, (1u << producer));
+    events_ext_ring_doorbell(x);
+    return true;
+}
+
+void events_ext_ctx_wake(events_ext_ctx_t *x) {
+    // pending before checking sleeping, pairs with events_ext_sleep()
+    atomic_fetch_or(&x->pending, EVENTS_EXT_PENDING_WAKE);
+    events_ext_ring_doorbell(x);
+}
+
+uint8_t events_ext_ctx_is_pending(events_ext_ctx_t *x) {
+    return (atomic_load_explicit(&x->pending, memory_order_relaxed) != 0) ||
+           ((x->futex != NULL) && (atomic_load_explicit(&x->futex->pending, memory_order_relaxed) != 0));
+}
+
+uint16_t events_ext_ctx_merge(events_ext_ctx_t *x) {
+    ext_ring_t *r;
+    unsigned int pending;
+    uint16_t wr, rd, cnt = 0;
+    uint8_t n;
+    event_t *ev;
+
+    if(atomic_load_explicit(&x->pending, memory_order_relaxed) == 0) {
+        // nothing staged, cheap check on every loop
+        return 0;
+    }
+    // the wake bit has no ring, the scheduler merges the rest after this
+    pending = atomic_exchange(&x->pending, 0) & ~EVENTS_EXT_PENDING_WAKE;
+    for(n = 0; pending != 0; n++, pending >>= 1) {
+        if((pending & 1) == 0) {
+            continue;
+        }
+        r = &x->rings[n];
+        rd = atomic_load_explicit(&r->rd, memory_order_relaxed);
+        wr = atomic_load_explicit(&r->wr, memory_order_acquire);
+        while(rd != wr) {
+            ev = &r->data[rd & (EVENTS_EXT_RING_SIZE - 1)];
+            if(scheduler_ctx_send_event(x->sched, ev->tid, ev->event, EVENT_DATA_UNPACK(ev->data)) == false) {
+                // main_fifo is full, keep the rest staged for the next merge
+                atomic_fetch_or(&x->pending, (1u << n));
+                break;
+            }
+            rd++;
+            cnt++;
+        }
+        atomic_store_explicit(&r->rd, rd, memory_order_release);
+    }
+    DEBUG_PRINTF_MESSAGE("events_ext_merge(): %d events\n", cnt);
+    return cnt;
+}
+
+void events_ext_ctx_sleep(events_ext_ctx_t *x) {
+    events_ext_idle_stats_t *st = &x->idle_stats;
+    struct pollfd pfd;
+    struct timespec ts, *timeout = NULL;
+    _Atomic uint64_t *ring_ns;
+    uint64_t deadline, now, cnt, start, latency;
+    uint32_t seq;
+    uint16_t merged;
+
+    now = events_ext_clock_ns();
+    if(x->idle_start_ns == 0) {
+        // a new idle period: spin first, during a burst the next event comes soon
+        x->idle_start_ns = now;
+        if(st->spin_window_ns) {
+            start = now;
+            while((events_ext_any_pending(x) == false) && ((now - start) < st->spin_window_ns)) {
+                arch_cpu_relax();
+                now = events_ext_clock_ns();
+            }
+            st->spin_ns += now - start;
+            if(events_ext_any_pending(x)) {
+                st->spin_hits++;
+                events_ext_ctx_merge(x);
+                events_shm_ctx_merge(x->sched);
+                events_ext_idle_end(x, now, true);
+                return;
+            }
+        }
+    }
+
+#ifdef EV_TIMER_HOST_CLOCK
+    // sleep until the next timer event is due
+    if(events_ctx_timer_next_deadline(&x->sched->events, &deadline) == true) {
+        deadline = events_ticks_to_ns(deadline);
+        now = events_ctx_get_time_ns(&x->sched->events);
+        deadline = (deadline > now) ? (deadline - now) : 0;
+        ts.tv_sec = deadline / 1000000000ull;
+        ts.tv_nsec = deadline % 1000000000ull;
+        timeout = &ts;
+    }
+#else
+    // ticks are counted elsewhere, do not sleep longer than 1 tick
+    deadline = events_ticks_to_ns(1);
+    ts.tv_sec = deadline / 1000000000ull;
+    ts.tv_nsec = deadline % 1000000000ull;
+    timeout = &ts;
+#endif
+    st->blocks++;
+    if(x->futex != NULL) {
+        // other processes send events too, they can only reach the futex doorbell
+        ring_ns = &x->futex->ring_ns;
+        seq = atomic_load(&x->futex->seq);
+        atomic_store(&x->sleeping, 1);
+        atomic_store(&x->futex->sleeping, 1);
+        // check again after announcing to sleep, pairs with events_ext_send(), events_shm_send_event()
+        if(events_ext_any_pending(x) == false) {
+            syscall(SYS_futex, &x->futex->seq, FUTEX_WAIT, seq, timeout, NULL, 0);
+        }
+        atomic_store(&x->futex->sleeping, 0);
+        atomic_store(&x->sleeping, 0);
+    }
+    else {
+        ring_ns = &x->ring_ns;
+        atomic_store(&x->sleeping, 1);
+        // check again after announcing to sleep, pairs with events_ext_send()
+        if(atomic_load(&x->pending) == 0) {
+            pfd.fd = x->doorbell;
+            pfd.events = POLLIN;
+            ppoll(&pfd, 1, timeout, NULL);
+        }
+        atomic_store(&x->sleeping, 0);
+        if(read(x->doorbell, &cnt, sizeof(cnt)) < 0) {
+            // doorbell was not rung
+        }
+    }
+    now = events_ext_clock_ns();
+    if((start = atomic_exchange(ring_ns, 0)) != 0) {
+        // woken up by the doorbell
+        latency = (now > start) ? (now - start) : 0;
+        st->wakeups++;
+        st->wakeup_latency_sum_ns += latency;
+        if(latency > st->wakeup_latency_max_ns) {
+            st->wakeup_latency_max_ns = latency;
+        }
+    }
+    merged = events_ext_ctx_merge(x);
+#ifdef EVENTS_SHM_ON
+    merged += events_shm_ctx_merge(x->sched);
+#endif
+    if(merged) {
+        events_ext_idle_end(x, now, true);
+    }
+    else if((events_ctx_is_main_fifo_empty(&x->sched->events) == false) ||
+            ((events_ctx_timer_next_deadline(&x->sched->events, &deadline) == true) &&
+             (deadline <= events_ctx_get_time_ticks(&x->sched->events)))) {
+        // ended by a timer event, the idle gap says nothing about the external events
+        events_ext_idle_end(x, now, false);
+    }
+}
+
+uint32_t events_ext_ctx_get_dropped(events_ext_ctx_t *x) {
+    return atomic_load(&x->dropped);
+}
+
+void events_ext_ctx_set_spin_max(events_ext_ctx_t *x, uint32_t spin_max_ns) {
+    x->spin_max_ns = spin_max_ns;
+    if(x->idle_stats.spin_window_ns > spin_max_ns) {
+        x->idle_stats.spin_window_ns = spin_max_ns;
+    }
+}
+
+void events_ext_ctx_get_idle_stats(events_ext_ctx_t *x, events_ext_idle_stats_t *stats) {
+    if(stats != NULL) {
+        *stats = x->idle_stats;
+    }
+}
+
+void events_ext_ctx_reset_idle_stats(events_ext_ctx_t *x) {
+    uint32_t window = x->idle_stats.spin_window_ns;
+    uint32_t gap = x->idle_stats.idle_gap_ns;
+    memset(&x->idle_stats, 0, sizeof(x->idle_stats));
+    x->idle_stats.spin_window_ns = window;
+    x->idle_stats.idle_gap_ns = gap;
+}
+
+// - default instance ----------------------------------------------------------
+// the external events of the scheduler instance that runs in this thread (default: scheduler_get_default_ctx())
+#define events_ext_ctx() (&scheduler_get_ctx()->ext)
+
+void events_ext_init(void) {
+    events_ext_ctx_init(&scheduler_get_default_ctx()->ext, scheduler_get_default_ctx());
+}
+
+uint8_t events_ext_register_producer(void) {
+    return events_ext_ctx_register_producer(events_ext_ctx());
+}
+
+int8_t events_ext_send(uint8_t producer, uint8_t tid, uint8_t event, void *data) {
+    return events_ext_ctx_send(events_ext_ctx(), producer, tid, event, data);
+}
+
+uint8_t events_ext_is_pending(void) {
+    return events_ext_ctx_is_pending(events_ext_ctx());
+}
+
+uint16_t events_ext_merge(void) {
+    return events_ext_ctx_merge(events_ext_ctx());
+}
+
+void events_ext_sleep(void) {
+    events_ext_ctx_sleep(events_ext_ctx());
+}
+
+uint32_t events_ext_get_dropped(void) {
+    return events_ext_ctx_get_dropped(events_ext_ctx());
+}
+
+void events_ext_set_spin_max(uint32_t spin_max_ns) {
+    events_ext_ctx_set_spin_max(events_ext_ctx(), spin_max_ns);
+}
+
+void events_ext_get_idle_stats(events_ext_idle_stats_t *stats) {
+    events_ext_ctx_get_idle_stats(events_ext_ctx(), stats);
+}
+
+void events_ext_reset_idle_stats(void) {
+    events_ext_ctx_reset_idle_stats(events_ext_ctx());
+}
+
+#endif // EVENTS_EXT_ON
@@ -0,0 +1,207 @@
+/**
+ * Martin Egli
+ * 2024-10-12
+ * external events: post events into the scheduler from POSIX threads,
+ * signal handlers and other non-scheduler contexts (host port)
+ * coop scheduler for mcu
+ *
+ * every producer gets its own lock-free single producer ring, the scheduler
+ * merges them into the main_fifo, a sleeping scheduler is woken up by an
+ * eventfd doorbell, define EVENTS_EXT_ON to use it
+ */
+
+#ifndef _EVENTS_EXT_H_
+#define _EVENTS_EXT_H_
+
+//- includes -------------------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+#include "events.h"
+
+//- defines --------------------------------------------------------------------
+#define EVENTS_EXT_NB_OF_PRODUCERS (8)  /// max. 31
+#define EVENTS_EXT_RING_SIZE (64)       /// events per producer, must be a power of 2
+#define EVENTS_EXT_NO_PRODUCER (0xFF)
+#ifndef EVENTS_EXT_SPIN_MAX_NS
+#define EVENTS_EXT_SPIN_MAX_NS (50000)  /// upper bound of the spin window before blocking, =0: block right away
+#endif
+
+#ifdef EVENTS_EXT_ON
+#include <stdatomic.h>
+
+//- typedefs -------------------------------------------------------------------
+/**
+ * single producer, single consumer ring
+ * wr, rd run freely, position = wr & (EVENTS_EXT_RING_SIZE - 1)
+ */
+typedef struct {
+    _Atomic uint16_t wr;    // written by the producer only
+    _Atomic uint16_t rd;    // written by the scheduler only
+    event_t data[EVENTS_EXT_RING_SIZE];
+} ext_ring_t;
+
+/**
+ * futex doorbell, replaces the eventfd if other processes send events too
+ * it lives in shared memory, see events_shm.h
+ */
+typedef struct {
+    _Atomic uint32_t seq;       // futex word, incremented to wake up the scheduler
+    _Atomic uint32_t sleeping;  // =1: scheduler waits on seq
+    _Atomic uint32_t pending;   // =1: events are staged in shared memory
+    _Atomic uint64_t ring_ns;   // CLOCK_MONOTONIC of the 1st ring, for the wakeup latency
+} ext_futex_t;
+
+/**
+ * statistics of the idle policy: spin first, then block on the doorbell
+ */
+typedef struct {
+    uint32_t spin_hits;     /// idle periods that ended while spinning, without a syscall
+    uint32_t blocks;        /// times the scheduler blocked on the doorbell
+    uint64_t spin_ns;       /// total time spent spinning
+    uint32_t spin_window_ns;    /// current spin window
+    uint32_t idle_gap_ns;   /// average idle time until the next external event (clamped)
+    uint32_t wakeups;       /// wakeups by the doorbell
+    uint64_t wakeup_latency_max_ns; /// from ringing the doorbell to the scheduler running
+    uint64_t wakeup_latency_sum_ns; /// average = wakeup_latency_sum_ns / wakeups
+} events_ext_idle_stats_t;
+
+struct scheduler_ctx_s;
+/**
+ * external events of 1 scheduler instance, embedded in scheduler_ctx_t
+ */
+typedef struct {
+    ext_ring_t rings[EVENTS_EXT_NB_OF_PRODUCERS];
+    atomic_uint producer_count;
+    atomic_uint pending;    // bit per ring with staged events
+    atomic_int sleeping;    // =1: scheduler waits for the doorbell
+    atomic_uint dropped;
+    int doorbell;           // eventfd
+    ext_futex_t *futex;     // =NULL: doorbell is the eventfd, see events_shm_create()
+    _Atomic uint64_t ring_ns;   // as ext_futex_t.ring_ns, for the eventfd
+    uint64_t idle_start_ns; // =0: not idle
+    uint32_t spin_max_ns;
+    events_ext_idle_stats_t idle_stats;
+    struct scheduler_ctx_s *sched;
+} events_ext_ctx_t;
+
+// - public functions ----------------------------------------------------------
+// the events_ext_*() functions use the scheduler instance that runs in the
+// calling thread, or the default instance, see scheduler_get_ctx()
+
+/**
+ * initialize the external events, create the doorbell
+ */
+void events_ext_init(void);
+
+/**
+ * register a producer, every thread (and every signal handler) that sends
+ * external events needs its own producer id
+ * @return  producer id, =EVENTS_EXT_NO_PRODUCER: error, no more producers
+ */
+uint8_t events_ext_register_producer(void);
+
+/**
+ * send an event to a task from outside the scheduler
+ * lock-free and async-signal-safe, wakes up a sleeping scheduler
+ * @param   producer    id from events_ext_register_producer()
+ * @param	tid		task identifier (SCHEDULER_TID_PUBLISH: publish)
+ * @param	event	event for the task to execute
+ * @param	data	additional data to task (if unused = NULL)
+ * @return	status 	=true: OK, event is staged
+ *					=false: error, invalid producer or its ring is full
+ */
+int8_t events_ext_send(uint8_t producer, uint8_t tid, uint8_t event, void *data);
+
+/**
+ * check if there are staged external events
+ * @return  =true: external events are waiting to be merged
+ */
+uint8_t events_ext_is_pending(void);
+
+/**
+ * merge all staged external events into the main_fifo
+ * call from the scheduler only
+ * @return  number of merged events
+ */
+uint16_t events_ext_merge(void);
+
+/**
+ * block until an external event arrives or the next timer event is due
+ * call from the scheduler only, if there is nothing to do
+ */
+void events_ext_sleep(void);
+
+/**
+ * get the number of external events dropped because a ring was full
+ * @return  number of dropped events
+ */
+uint32_t events_ext_get_dropped(void);
+
+/**
+ * set the upper bound of the spin window
+ * before it blocks, the idle scheduler spins for a while, an event that
+ * arrives during a burst is picked up without a syscall, the window adapts
+ * to the recent idle gaps: about twice the average gap, 0 if the gaps are
+ * longer than spin_max_ns (no core is burnt between bursts)
+ * @param   spin_max_ns     time in ns, =0: block right away
+ */
+void events_ext_set_spin_max(uint32_t spin_max_ns);
+
+/**
+ * get the statistics of the idle policy
+ * @param   stats   pointer to copy the statistics to
+ */
+void events_ext_get_idle_stats(events_ext_idle_stats_t *stats);
+
+/**
+ * reset the statistics of the idle policy, the spin window is kept
+ */
+void events_ext_reset_idle_stats(void);
+
+// - scheduler instances -------------------------------------------------------
+// same as the functions above, on the external events of a given scheduler instance
+
+/**
+ * initialize the external events of a scheduler instance
+ * @param   x       external events to initialize
+ * @param   sched   scheduler instance to merge the events into
+ */
+void events_ext_ctx_init(events_ext_ctx_t *x, struct scheduler_ctx_s *sched);
+
+/**
+ * close the doorbell of a scheduler instance, see scheduler_ctx_destroy()
+ * @param   x       external events to close
+ */
+void events_ext_ctx_destroy(events_ext_ctx_t *x);
+uint8_t events_ext_ctx_register_producer(events_ext_ctx_t *x);
+
+/**
+ * wake up the scheduler of an instance if it sleeps, after something other
+ * than an external event was staged for it (e.g. a timer event from an ISR,
+ * see scheduler_add_timer_event_from_isr()), lock-free and async-signal-safe
+ * @param   x       external events of the instance
+ */
+void events_ext_ctx_wake(events_ext_ctx_t *x);
+int8_t events_ext_ctx_send(events_ext_ctx_t *x, uint8_t producer, uint8_t tid, uint8_t event, void *data);
+uint8_t events_ext_ctx_is_pending(events_ext_ctx_t *x);
+uint16_t events_ext_ctx_merge(events_ext_ctx_t *x);
+void events_ext_ctx_sleep(events_ext_ctx_t *x);
+uint32_t events_ext_ctx_get_dropped(events_ext_ctx_t *x);
+void events_ext_ctx_set_spin_max(events_ext_ctx_t *x, uint32_t spin_max_ns);
+void events_ext_ctx_get_idle_stats(events_ext_ctx_t *x, events_ext_idle_stats_t *stats);
+void events_ext_ctx_reset_idle_stats(events_ext_ctx_t *x);
+
+#else
+#define events_ext_init()
+#define events_ext_is_pending() (false)
+#define events_ext_merge()
+#define events_ext_sleep()
+#define events_ext_ctx_init(x, sched)
+#define events_ext_ctx_destroy(x)
+#define events_ext_ctx_wake(x)
+#define events_ext_ctx_is_pending(x) (false)
+#define events_ext_ctx_merge(x)
+#define events_ext_ctx_sleep(x)
+#endif // EVENTS_EXT_ON
+
+#endif // _EVENTS_EXT_H_
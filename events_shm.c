@@ -0,0 +1,135 @@
+/**
+ * Martin Egli
+ * 2024-10-18
+ * shared memory events: the scheduler side of the ring (host port)
+ * coop scheduler for mcu
+ */
+
+// - includes ------------------------------------------------------------------
+#include "events_shm.h"
+
+#ifdef EVENTS_SHM_ON
+#include <stdatomic.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "scheduler.h"
+#include "dlog.h"
+
+#if (EVENTS_SHM_RING_SIZE & (EVENTS_SHM_RING_SIZE - 1)) != 0
+#error "EVENTS_SHM_RING_SIZE must be a power of 2"
+#endif
+
+// - public functions ----------------------------------------------------------
+int8_t events_shm_ctx_create(scheduler_ctx_t *ctx, const char *name) {
+    events_shm_t *shm;
+    int fd;
+
+    if((ctx == NULL) || (name == NULL) || (strlen(name) >= EVENTS_SHM_NAME_LEN) || (ctx->shm != NULL)) {
+        return false;
+    }
+    // a new object, clients of a previous process keep their old mapping
+    shm_unlink(name);
+    if((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0) {
+        return false;
+    }
+    // a new object is filled with 0: the ring is empty and valid
+    if(ftruncate(fd, sizeof(events_shm_t)) != 0) {
+        close(fd);
+        shm_unlink(name);
+        return false;
+    }
+    shm = mmap(NULL, sizeof(events_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(shm == MAP_FAILED) {
+        shm_unlink(name);
+        return false;
+    }
+    shm->version = EVENTS_SHM_VERSION;
+    shm->ring_size = EVENTS_SHM_RING_SIZE;
+    strcpy(shm->name, name);
+    // clients can connect from now on
+    atomic_thread_fence(memory_order_release);
+    shm->magic = EVENTS_SHM_MAGIC;
+    ctx->shm = shm;
+    // the clients can only reach the futex doorbell
+    ctx->ext.futex = &shm->doorbell;
+    return true;
+}
+
+uint16_t events_shm_ctx_merge(scheduler_ctx_t *ctx) {
+    events_shm_t *shm = ctx->shm;
+    events_shm_slot_t *s;
+    uint32_t n;
+    uint16_t cnt = 0;
+
+    if((shm == NULL) || (atomic_load_explicit(&shm->doorbell.pending, memory_order_relaxed) == 0)) {
+        // nothing sent, cheap check on every loop
+        return 0;
+    }
+    atomic_exchange(&shm->doorbell.pending, 0);
+    while(1) {
+        n = shm->rd & (EVENTS_SHM_RING_SIZE - 1);
+        s = &shm->slot[n];
+        if(atomic_load_explicit(&s->seq, memory_order_acquire) != shm->rd - n + 1) {
+            // no more events, or a client is still writing this one (it sets pending again)
+            break;
+        }
+        if(scheduler_ctx_send_event(ctx, s->tid, s->event, (void *)(uintptr_t)s->data) == false) {
+            // main_fifo is full, keep the rest in the ring for the next merge
+            atomic_store(&shm->doorbell.pending, 1);
+            break;
+        }
+        // free the slot for the next round of the ring
+        atomic_store_explicit(&s->seq, shm->rd - n + EVENTS_SHM_RING_SIZE, memory_order_release);
+        shm->rd++;
+        cnt++;
+    }
+    DLOG_DEBUG("events_shm_merge(): %llu events\n", cnt);
+    return cnt;
+}
+
+uint8_t events_shm_ctx_is_pending(scheduler_ctx_t *ctx) {
+    return (ctx->shm != NULL) && (atomic_load_explicit(&ctx->shm->doorbell.pending, memory_order_relaxed) != 0);
+}
+
+uint32_t events_shm_ctx_get_dropped(scheduler_ctx_t *ctx) {
+    if(ctx->shm == NULL) {
+        return 0;
+    }
+    return atomic_load(&ctx->shm->dropped);
+}
+
+void events_shm_ctx_destroy(scheduler_ctx_t *ctx) {
+    if(ctx->shm == NULL) {
+        return;
+    }
+    ctx->ext.futex = NULL;
+    shm_unlink(ctx->shm->name);
+    munmap(ctx->shm, sizeof(events_shm_t));
+    ctx->shm = NULL;
+}
+
+// - default instance ----------------------------------------------------------
+int8_t events_shm_create(const char *name) {
+    return events_shm_ctx_create(scheduler_get_ctx(), name);
+}
+
+uint16_t events_shm_merge(void) {
+    return events_shm_ctx_merge(scheduler_get_ctx());
+}
+
+uint8_t events_shm_is_pending(void) {
+    return events_shm_ctx_is_pending(scheduler_get_ctx());
+}
+
+uint32_t events_shm_get_dropped(void) {
+    return events_shm_ctx_get_dropped(scheduler_get_ctx());
+}
+
+void events_shm_destroy(void) {
+    events_shm_ctx_destroy(scheduler_get_ctx());
+}
+
+#endif // EVENTS_SHM_ON
@@ -0,0 +1,143 @@
+/**
+ * Martin Egli
+ * 2024-10-18
+ * shared memory events: other processes post events into a running
+ * scheduler through a lock-free ring in shared memory (host port)
+ * coop scheduler for mcu
+ *
+ * the scheduler creates the ring (shm_open(), mmap()), any number of client
+ * processes connect and send events without a syscall, only a sleeping
+ * scheduler is woken up by the futex doorbell in the ring, the scheduler
+ * merges the ring into the main_fifo like the external events
+ * define EVENTS_SHM_ON (needs EVENTS_EXT_ON) to use it
+ */
+
+#ifndef _EVENTS_SHM_H_
+#define _EVENTS_SHM_H_
+
+//- includes -------------------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+#include "events_ext.h"
+
+//- defines --------------------------------------------------------------------
+#ifndef EVENTS_SHM_RING_SIZE
+#define EVENTS_SHM_RING_SIZE (256)      /// events in the ring, must be a power of 2
+#endif
+#define EVENTS_SHM_MAGIC (0x48534D4Du)  /// "MMSH"
+#define EVENTS_SHM_VERSION (2)
+#define EVENTS_SHM_NAME_LEN (32)
+
+#ifdef EVENTS_SHM_ON
+#ifndef EVENTS_EXT_ON
+#error "EVENTS_SHM_ON needs EVENTS_EXT_ON"
+#endif
+
+//- typedefs -------------------------------------------------------------------
+/**
+ * 1 event in the ring, no pointers: data is a value for the other process
+ * seq counts relative to the index n of the slot, so a zeroed ring is valid:
+ * =pos - n: free for position pos, =pos - n + 1: written
+ */
+typedef struct {
+    _Atomic uint32_t seq;
+    uint8_t tid;
+    uint8_t event;
+    uint64_t data;
+} events_shm_slot_t;
+
+/**
+ * the shared memory region, multi producer (client processes), single
+ * consumer (scheduler), the layout must be the same in all processes
+ */
+typedef struct events_shm_s {
+    uint32_t magic;         /// set last by the scheduler, clients check it
+    uint16_t version;
+    uint16_t ring_size;
+    char name[EVENTS_SHM_NAME_LEN];     /// to remove it, see events_shm_destroy()
+    ext_futex_t doorbell;
+    _Alignas(64) _Atomic uint32_t wr;   // claimed by the clients, runs freely
+    _Alignas(64) uint32_t rd;           // read by the scheduler only, runs freely
+    _Atomic uint32_t dropped;
+    events_shm_slot_t slot[EVENTS_SHM_RING_SIZE];
+} events_shm_t;
+
+// - public functions: scheduler -----------------------------------------------
+// the events_shm_*() functions use the scheduler instance that runs in the
+// calling thread, or the default instance, see scheduler_get_ctx()
+
+/**
+ * create the shared memory ring of the scheduler, a ring of the same name
+ * from a previous process is replaced, its clients must connect again
+ * the scheduler sleeps on the futex doorbell of the ring from now on
+ * @param   name    of the shared memory object, "/name", see shm_open()
+ * @return  =true: OK, =false: error, could not create or map the ring
+ */
+int8_t events_shm_create(const char *name);
+
+/**
+ * merge the events from the ring into the main_fifo
+ * called by the scheduler, see scheduler_run_once()
+ * @return  number of merged events
+ */
+uint16_t events_shm_merge(void);
+
+/**
+ * check if clients sent events that are not yet merged
+ * @return  =true: events are waiting in the ring
+ */
+uint8_t events_shm_is_pending(void);
+
+/**
+ * get the number of events the clients dropped because the ring was full
+ * @return  number of dropped events
+ */
+uint32_t events_shm_get_dropped(void);
+
+/**
+ * unmap and remove the ring, the scheduler uses the eventfd doorbell again
+ */
+void events_shm_destroy(void);
+
+// - public functions: clients -------------------------------------------------
+// events_shm_client.c, does not need the scheduler, link it into the clients
+
+/**
+ * connect to the ring of a running scheduler
+ * @param   name    of the shared memory object, as given to events_shm_create()
+ * @return  the ring, =NULL: error, no such ring or another layout
+ */
+events_shm_t *events_shm_connect(const char *name);
+
+/**
+ * send an event to a task of the scheduler, as scheduler_send_event()
+ * lock-free, no syscall unless the scheduler sleeps
+ * @param   shm     ring from events_shm_connect()
+ * @param	tid		task identifier (SCHEDULER_TID_PUBLISH: publish)
+ * @param	event	event for the task to execute
+ * @param	data	value, the task gets (void *)data (32 bit with EVENTS_COMPACT)
+ * @return	status 	=true: OK, event is in the ring
+ *					=false: error, the ring is full
+ */
+int8_t events_shm_send_event(events_shm_t *shm, uint8_t tid, uint8_t event, uint64_t data);
+
+/**
+ * unmap the ring of the scheduler
+ * @param   shm     ring from events_shm_connect()
+ */
+void events_shm_disconnect(events_shm_t *shm);
+
+// - scheduler instances -------------------------------------------------------
+struct scheduler_ctx_s;
+int8_t events_shm_ctx_create(struct scheduler_ctx_s *ctx, const char *name);
+uint16_t events_shm_ctx_merge(struct scheduler_ctx_s *ctx);
+uint8_t events_shm_ctx_is_pending(struct scheduler_ctx_s *ctx);
+uint32_t events_shm_ctx_get_dropped(struct scheduler_ctx_s *ctx);
+void events_shm_ctx_destroy(struct scheduler_ctx_s *ctx);
+
+#else
+#define events_shm_ctx_merge(ctx)
+#define events_shm_ctx_is_pending(ctx) (false)
+#endif // EVENTS_SHM_ON
+
+#endif // _EVENTS_SHM_H_
@@ -0,0 +1,103 @@
+/**
+ * Martin Egli
+ * 2024-10-18
+ * shared memory events: the client side of the ring, for other processes
+ * it does not need the scheduler (host port)
+ * coop scheduler for mcu
+ */
+
+// - includes ------------------------------------------------------------------
+#include "events_shm.h"
+
+#ifdef EVENTS_SHM_ON
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+// - public functions ----------------------------------------------------------
+events_shm_t *events_shm_connect(const char *name) {
+    events_shm_t *shm;
+    int fd;
+
+    if((fd = shm_open(name, O_RDWR, 0)) < 0) {
+        return NULL;
+    }
+    shm = mmap(NULL, sizeof(events_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(shm == MAP_FAILED) {
+        return NULL;
+    }
+    if((shm->magic != EVENTS_SHM_MAGIC) || (shm->version != EVENTS_SHM_VERSION) ||
+       (shm->ring_size != EVENTS_SHM_RING_SIZE)) {
+        // error, not yet created or another build of the scheduler
+        munmap(shm, sizeof(events_shm_t));
+        return NULL;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    return shm;
+}
+
+int8_t events_shm_send_event(events_shm_t *shm, uint8_t tid, uint8_t event, uint64_t data) {
+    events_shm_slot_t *s;
+    struct timespec ts;
+    uint64_t ring_ns;
+    uint32_t pos, n;
+    int32_t diff;
+
+    if(shm == NULL) {
+        return false;
+    }
+    pos = atomic_load_explicit(&shm->wr, memory_order_relaxed);
+    while(1) {
+        n = pos & (EVENTS_SHM_RING_SIZE - 1);
+        s = &shm->slot[n];
+        diff = (int32_t)(atomic_load_explicit(&s->seq, memory_order_acquire) - (pos - n));
+        if(diff == 0) {
+            // slot is free, claim it
+            if(atomic_compare_exchange_weak_explicit(&shm->wr, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if(diff < 0) {
+            // error, not yet merged, the ring is full
+            atomic_fetch_add_explicit(&shm->dropped, 1, memory_order_relaxed);
+            return false;
+        }
+        else {
+            pos = atomic_load_explicit(&shm->wr, memory_order_relaxed);
+        }
+    }
+    s->tid = tid;
+    s->event = event;
+    s->data = data;
+    atomic_store_explicit(&s->seq, pos - n + 1, memory_order_release);
+
+    // pending before checking sleeping, pairs with events_ext_sleep()
+    atomic_store(&shm->doorbell.pending, 1);
+    if(atomic_load(&shm->doorbell.sleeping)) {
+        // only a sleeping scheduler costs a syscall
+        if(atomic_load_explicit(&shm->doorbell.ring_ns, memory_order_relaxed) == 0) {
+            // 1st ring, for the wakeup latency of the scheduler
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            ring_ns = 0;
+            atomic_compare_exchange_strong(&shm->doorbell.ring_ns, &ring_ns,
+                (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec);
+        }
+        atomic_fetch_add(&shm->doorbell.seq, 1);
+        syscall(SYS_futex, &shm->doorbell.seq, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+    return true;
+}
+
+void events_shm_disconnect(events_shm_t *shm) {
+    if(shm != NULL) {
+        munmap(shm, sizeof(events_shm_t));
+    }
+}
+
+#endif // EVENTS_SHM_ON
@@ -14,10 +14,12 @@
 #include <string.h>
 #include "power_mode.h"
 #include "events.h"
+#include "events_ext.h"
 
 // - private variables ---------------------------------------------------------
 static uint8_t power_mode_cnt[NB_OF_POWER_MODES];
 #define POWER_MODE_CNT_MAX (250)
+static power_mode_stats_t power_mode_stats;
 
 // - private functions ---------------------------------------------------------
 /**
@@ -31,9 +33,71 @@ static inline uint8_t get_deepest_power_mode(void) {
 	return POWER_MODE_2; // deepest anyways
 }
 
+/**
+ * count the cause of a wakeup: the 1st event to process after the sleep
+ */
+static void power_mode_count_wake_cause(void) {
+	power_mode_wake_cause_t *c;
+	event_t ev;
+	uint64_t deadline;
+	uint8_t n, flags = 0;
+
+	if(events_peek_main_fifo(&ev) == false) {
+		return;
+	}
+	if(ev.event == EV_POLL) {
+		// a tick of the event timer, the task of a due timer event is the cause
+		flags = POWER_MODE_WAKE_TIMER;
+		if((events_timer_next_deadline(&deadline) == true) &&
+		   (deadline <= events_get_clock_ticks())) {
+			events_peek_timer_event(&ev);
+		}
+	}
+	for(n = 0; n < POWER_MODE_NB_OF_WAKE_CAUSES; n++) {
+		c = &power_mode_stats.cause[n];
+		if(c->count == 0) {
+			// new cause
+			c->tid = ev.tid;
+			c->event = ev.event;
+			c->flags = flags;
+		}
+		if((c->tid == ev.tid) && (c->event == ev.event) && (c->flags == flags)) {
+			c->count++;
+			return;
+		}
+	}
+	power_mode_stats.causes_other++;
+}
+
+/**
+ * wait as long there is no event to process, count the wakeups
+ */
+static void power_mode_wait(power_mode_residency_t *r) {
+#ifndef EVENTS_EXT_ON
+	uint8_t waited = false;
+#endif
+	while (events_is_main_fifo_empty() == true) {
+		events_merge_staged_timer_events(); // timer events staged by ISRs, other threads
+		events_timer_poll(); // host port: check for due timer events
+#ifdef EVENTS_EXT_ON
+		events_ext_sleep(); // host port: wait for external events
+		r->wakeups++;
+#else
+		// host port: busy wait, 1 wakeup when the event arrives
+		waited = true;
+#endif
+	}
+#ifndef EVENTS_EXT_ON
+	if(waited) {
+		r->wakeups++;
+	}
+#endif
+}
+
 // - public functions ----------------------------------------------------------
 void power_mode_init(void) {
 	memset(power_mode_cnt, 0, sizeof(power_mode_cnt));
+	memset(&power_mode_stats, 0, sizeof(power_mode_stats));
 }
 
 void power_mode_request(uint8_t mode) {
@@ -57,19 +121,40 @@ void power_mode_release(uint8_t mode) {
 }
 
 void power_mode_sleep(void) {
-	switch(get_deepest_power_mode()) {
+	power_mode_residency_t *r;
+	uint64_t start;
+	uint8_t mode;
+
+	mode = get_deepest_power_mode();
+	r = &power_mode_stats.mode[mode];
+	r->entries++;
+	// the timer task does not run during the sleep, count the pending ticks too
+	start = events_get_clock_ns();
+	switch(mode) {
 		case POWER_MODE_NONE:
 			// do not go to power, just idle here
-			while (events_is_main_fifo_empty() == true);
+			power_mode_wait(r);
 			break;
 		case POWER_MODE_1:
 			// - mcu specific code here ------------
-				while (events_is_main_fifo_empty() == true);
+				power_mode_wait(r);
 			break;
 		case POWER_MODE_2:
 			// - mcu specific code here ------------
-				while (events_is_main_fifo_empty() == true);
+				power_mode_wait(r);
 			break;
 	}
+	r->time_ns += events_get_clock_ns() - start;
+	power_mode_count_wake_cause();
 	return;
 }
+
+void power_mode_get_stats(power_mode_stats_t *stats) {
+	if(stats != NULL) {
+		memcpy(stats, &power_mode_stats, sizeof(*stats));
+	}
+}
+
+void power_mode_reset_stats(void) {
+	memset(&power_mode_stats, 0, sizeof(power_mode_stats));
+}
@@ -21,6 +21,35 @@
 #define POWER_MODE_NONE (0)
 #define POWER_MODE_1 (1)
 #define POWER_MODE_2 (2)
+#define POWER_MODE_NB_OF_WAKE_CAUSES (16) /// different wakeup causes that are counted
+
+//- typedefs -------------------------------------------------------------------
+/**
+ * residency of 1 power mode
+ */
+typedef struct {
+    uint64_t time_ns;   /// time spent in this mode
+    uint32_t entries;   /// number of times the mode was entered (power_mode_sleep())
+    uint32_t wakeups;   /// number of wakeups in this mode, also those without an event (e.g. a tick)
+} power_mode_residency_t;
+
+/**
+ * 1 wakeup cause: the 1st event after the sleep
+ */
+typedef struct {
+    uint8_t tid;        /// task that got the event, for a timer event: the task of the timer event
+    uint8_t event;
+    uint8_t flags;
+    uint32_t count;     /// number of sleeps ended by this cause
+} power_mode_wake_cause_t;
+// .flags
+#define POWER_MODE_WAKE_TIMER (1<<0) /// a timer event, or a tick of the event timer (event: EV_POLL)
+
+typedef struct {
+    power_mode_residency_t mode[NB_OF_POWER_MODES];
+    power_mode_wake_cause_t cause[POWER_MODE_NB_OF_WAKE_CAUSES];  /// in order of appearance, count = 0: unused
+    uint32_t causes_other;  /// sleeps ended by causes that did not fit into cause[]
+} power_mode_stats_t;
 
 // - public functions ----------------------------------------------------------
 
@@ -43,7 +72,20 @@ void power_mode_release(uint8_t mode);
 
 /**
  * wait here as long there is no event to process
+ * the time in the deepest requested power mode and the cause of the wakeup
+ * are recorded, see power_mode_get_stats()
  */
 void power_mode_sleep(void);
 
+/**
+ * get the residency and wakeup statistics
+ * @param stats pointer to copy the statistics to
+ */
+void power_mode_get_stats(power_mode_stats_t *stats);
+
+/**
+ * reset the residency and wakeup statistics
+ */
+void power_mode_reset_stats(void);
+
 #endif // _POWER_MODE_H_
@@ -0,0 +1,226 @@
+/**
+ * Martin Egli
+ * 2024-10-19
+ * record and replay the external inputs of the scheduler (host port)
+ * coop scheduler for mcu
+ */
+
+// - includes ------------------------------------------------------------------
+#include "replay.h"
+
+#ifdef REPLAY_ON
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "scheduler.h"
+
+// - private functions ---------------------------------------------------------
+static uint64_t replay_clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * run the scheduler until it is idle
+ * @return  number of dispatched events and idle slices
+ */
+static uint32_t replay_run_idle(scheduler_ctx_t *ctx) {
+    uint32_t cnt = 0;
+    while(scheduler_ctx_run_once(ctx) == true) {
+        cnt++;
+    }
+    return cnt;
+}
+
+/**
+ * advance the event timer to target, skip to the due timer events in between
+ * @param   target  time in ticks
+ * @return  number of dispatched events and idle slices
+ */
+static uint32_t replay_advance(scheduler_ctx_t *ctx, uint64_t target) {
+    uint64_t now, next, step;
+    uint32_t cnt;
+
+    cnt = replay_run_idle(ctx);
+    now = events_ctx_get_time_ticks(&ctx->events);
+    while(now < target) {
+        step = target - now;
+        if((events_ctx_timer_next_deadline(&ctx->events, &next) == true) && (next > now) && (next < target)) {
+            // the timer events due before the next input run at their time
+            step = next - now;
+        }
+        if(step > 0xFFFFFFFF) {
+            step = 0xFFFFFFFF;
+        }
+        events_ctx_timer_tick(&ctx->events, (uint32_t)step);
+        cnt += replay_run_idle(ctx);
+        next = events_ctx_get_time_ticks(&ctx->events);
+        if(next == now) {
+            // the event timer does not run, see scheduler_start_event_timer()
+            break;
+        }
+        now = next;
+    }
+    return cnt;
+}
+
+// - public functions ----------------------------------------------------------
+int8_t replay_ctx_record_start(scheduler_ctx_t *ctx, const char *path) {
+    replay_header_t h;
+    FILE *f;
+
+    if((ctx == NULL) || (path == NULL) || (ctx->replay_file != NULL)) {
+        return false;
+    }
+    if((f = fopen(path, "wb")) == NULL) {
+        return false;
+    }
+    memset(&h, 0, sizeof(h));
+    h.magic = REPLAY_MAGIC;
+    h.version = REPLAY_VERSION;
+    h.record_size = sizeof(replay_record_t);
+    h.tick_hz = EV_TIMER_TICK_HZ;
+    if(fwrite(&h, sizeof(h), 1, f) != 1) {
+        fclose(f);
+        return false;
+    }
+    ctx->replay_file = f;
+    return true;
+}
+
+void replay_ctx_record_stop(scheduler_ctx_t *ctx) {
+    replay_record_t r;
+    FILE *f;
+
+    if((ctx == NULL) || ((f = ctx->replay_file) == NULL)) {
+        return;
+    }
+    ctx->replay_file = NULL;
+    memset(&r, 0, sizeof(r));
+    r.ticks = events_ctx_get_time_ticks(&ctx->events);
+    r.type = REPLAY_STOP;
+    fwrite(&r, sizeof(r), 1, f);
+    fclose(f);
+}
+
+/**
+ * write 1 record, in the scheduler thread only
+ */
+static void replay_write(scheduler_ctx_t *ctx, uint8_t type, uint8_t tid, uint8_t event, void *data, uint64_t arg) {
+    replay_record_t r;
+
+    if((ctx->replay_file == NULL) || (tid == ctx->events.timer_proc.tid) || (tid == SCHEDULER_TID_DEFER)) {
+        // not recording, a tick, or a deferred call (a function pointer does not replay)
+        return;
+    }
+    r.ticks = events_ctx_get_time_ticks(&ctx->events);
+    r.data = (uint64_t)(uintptr_t)data;
+    if(type == REPLAY_ARM_AT) {
+        // relative to the time of the input, the replay runs on another clock
+        arg = (arg > r.ticks) ? (arg - r.ticks) : 0;
+    }
+    r.arg = (arg > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t)arg;
+    r.type = type;
+    r.tid = tid;
+    r.event = event;
+    r.reserved = 0;
+    fwrite(&r, sizeof(r), 1, (FILE *)ctx->replay_file);
+}
+
+void replay_ctx_record(scheduler_ctx_t *ctx, uint8_t type, uint8_t tid, uint8_t event, void *data, uint64_t arg) {
+    if(ctx->dispatching) {
+        // an input from the tasks, it replays by itself
+        return;
+    }
+    replay_write(ctx, type, tid, event, data, arg);
+}
+
+void replay_ctx_record_staged(scheduler_ctx_t *ctx, uint8_t type, uint8_t tid, uint8_t event, void *data, uint64_t arg) {
+    // from ISRs or other threads, never replays by itself
+    replay_write(ctx, type, tid, event, data, arg);
+}
+
+int8_t replay_ctx_run(scheduler_ctx_t *ctx, const char *path, replay_stats_t *stats) {
+    replay_header_t h;
+    replay_record_t r;
+    replay_stats_t st;
+    uint64_t offset = 0, first = 0, target, now;
+    uint8_t started = false;
+    void *data;
+    FILE *f;
+
+#ifdef EV_TIMER_HOST_CLOCK
+    // the host clock cannot skip ahead
+    return false;
+#endif
+    if((ctx == NULL) || (path == NULL) || ((f = fopen(path, "rb")) == NULL)) {
+        return false;
+    }
+    if((fread(&h, sizeof(h), 1, f) != 1) || (h.magic != REPLAY_MAGIC) || (h.version != REPLAY_VERSION) ||
+       (h.record_size != sizeof(replay_record_t)) || (h.tick_hz != EV_TIMER_TICK_HZ)) {
+        // error, not a recording or from another build
+        fclose(f);
+        return false;
+    }
+    memset(&st, 0, sizeof(st));
+    st.wall_ns = replay_clock_ns();
+    while(fread(&r, sizeof(r), 1, f) == 1) {
+        now = events_ctx_get_time_ticks(&ctx->events);
+        if(started == false) {
+            // the recording starts now
+            started = true;
+            first = r.ticks;
+            offset = now - r.ticks;
+        }
+        // records of other threads can be a little out of order, never go back
+        target = r.ticks + offset;
+        st.dispatched += replay_advance(ctx, target);
+        now = events_ctx_get_time_ticks(&ctx->events);
+        data = (void *)(uintptr_t)r.data;
+        switch(r.type) {
+            case REPLAY_SEND:
+                scheduler_ctx_send_event(ctx, r.tid, r.event, data);
+                break;
+            case REPLAY_SEND_COALESCED:
+                scheduler_ctx_send_event_coalesced(ctx, r.tid, r.event, data);
+                break;
+            case REPLAY_ARM:
+                scheduler_ctx_add_timer_event(ctx, r.arg, r.tid, r.event, data);
+                break;
+            case REPLAY_ARM_AT:
+                scheduler_ctx_add_timer_event_at(ctx, now + r.arg, r.tid, r.event, data);
+                break;
+            case REPLAY_CANCEL:
+                scheduler_ctx_cancel_timer_events(ctx, r.tid, r.event);
+                break;
+        }
+        st.ticks = (r.ticks > first) ? (r.ticks - first) : st.ticks;
+        if(r.type == REPLAY_STOP) {
+            break;
+        }
+        st.records++;
+    }
+    fclose(f);
+    st.dispatched += replay_run_idle(ctx);
+    st.wall_ns = replay_clock_ns() - st.wall_ns;
+    if(stats != NULL) {
+        *stats = st;
+    }
+    return true;
+}
+
+// - default instance ----------------------------------------------------------
+int8_t replay_record_start(const char *path) {
+    return replay_ctx_record_start(scheduler_get_ctx(), path);
+}
+
+void replay_record_stop(void) {
+    replay_ctx_record_stop(scheduler_get_ctx());
+}
+
+int8_t replay_run(const char *path, replay_stats_t *stats) {
+    return replay_ctx_run(scheduler_get_ctx(), path, stats);
+}
+
+#endif // REPLAY_ON
@@ -0,0 +1,126 @@
+/**
+ * Martin Egli
+ * 2024-10-19
+ * record and replay the external inputs of the scheduler (host port)
+ * the recorder writes every event sent from outside the tasks, every timer
+ * event armed or cancelled from outside and the time of each of them into a
+ * binary file, the replay driver feeds the file back into a scheduler
+ * instance as fast as possible, the same input on every build
+ * define REPLAY_ON to use it
+ * coop scheduler for mcu
+ */
+
+#ifndef _REPLAY_H_
+#define _REPLAY_H_
+
+//- includes -------------------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+
+//- defines --------------------------------------------------------------------
+#define REPLAY_MAGIC (0x50524D4Du)  /// "MMRP"
+#define REPLAY_VERSION (1)
+
+// replay_record_t.type
+#define REPLAY_SEND (1)             /// scheduler_send_event(), tid = SCHEDULER_TID_PUBLISH: publish
+#define REPLAY_SEND_COALESCED (2)   /// scheduler_send_event_coalesced()
+#define REPLAY_ARM (3)              /// scheduler_add_timer_event(), arg: timeout
+#define REPLAY_ARM_AT (4)           /// scheduler_add_timer_event_at(), arg: deadline - ticks
+#define REPLAY_CANCEL (5)           /// scheduler_cancel_timer_events()
+#define REPLAY_STOP (6)             /// replay_record_stop(), end of the recording
+
+#ifdef REPLAY_ON
+
+//- typedefs -------------------------------------------------------------------
+/**
+ * file header, followed by the records
+ */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;   /// sizeof(replay_record_t)
+    uint32_t tick_hz;       /// EV_TIMER_TICK_HZ of the recording
+    uint32_t reserved;
+} replay_header_t;
+
+/**
+ * 1 external input, 24 bytes
+ * data is saved as a value, pointers do not replay
+ */
+typedef struct {
+    uint64_t ticks;         /// time of the input, see events_get_time_ticks()
+    uint64_t data;
+    uint32_t arg;           /// depends on type
+    uint8_t type;
+    uint8_t tid;
+    uint8_t event;
+    uint8_t reserved;
+} replay_record_t;
+
+/**
+ * result of a replay
+ */
+typedef struct {
+    uint32_t records;       /// number of replayed records
+    uint32_t dispatched;    /// number of events and idle slices dispatched
+    uint64_t ticks;         /// replayed time, in ticks of the recording
+    uint64_t wall_ns;       /// time the replay took
+} replay_stats_t;
+
+struct scheduler_ctx_s;
+
+// - public functions ----------------------------------------------------------
+// the replay_*() functions use the scheduler instance that runs in the
+// calling thread, or the default instance, see scheduler_get_ctx()
+
+/**
+ * start recording the external inputs
+ * inputs are external if they do not come from the tasks, deferred calls or
+ * idle tasks of the instance: from main(), other threads through
+ * events_ext_send(), other processes, timer requests from ISRs
+ * (scheduler_add_timer_event_from_isr()), all are recorded in the scheduler
+ * thread when they are merged, start and stop the recording there too
+ * @param   path    of the recording, overwritten
+ * @return  =true: OK, =false: error, could not create the file
+ */
+int8_t replay_record_start(const char *path);
+
+/**
+ * stop recording, close the file
+ * the replay runs the timer events up to this time
+ */
+void replay_record_stop(void);
+
+/**
+ * replay a recording, as fast as possible
+ * the tasks must be added and started as in the recording (same tids)
+ * between 2 inputs the event timer skips to the next due timer event, the
+ * tasks see the time of the recording, needs the event timer to count ticks
+ * (not with EV_TIMER_HOST_CLOCK)
+ * @param   path    of the recording
+ * @param   stats   pointer to store the result, =NULL: not needed
+ * @return  =true: OK, =false: error, no such file, another format or host clock
+ */
+int8_t replay_run(const char *path, replay_stats_t *stats);
+
+// - scheduler instances -------------------------------------------------------
+int8_t replay_ctx_record_start(struct scheduler_ctx_s *ctx, const char *path);
+void replay_ctx_record_stop(struct scheduler_ctx_s *ctx);
+int8_t replay_ctx_run(struct scheduler_ctx_s *ctx, const char *path, replay_stats_t *stats);
+
+/**
+ * record 1 external input, called by the scheduler, not while it dispatches
+ */
+void replay_ctx_record(struct scheduler_ctx_s *ctx, uint8_t type, uint8_t tid, uint8_t event, void *data, uint64_t arg);
+
+/**
+ * record 1 staged timer request (ISRs, other threads), called by the scheduler when it merges it
+ */
+void replay_ctx_record_staged(struct scheduler_ctx_s *ctx, uint8_t type, uint8_t tid, uint8_t event, void *data, uint64_t arg);
+
+#else
+#define replay_ctx_record(ctx, type, tid, event, data, arg)
+#define replay_ctx_record_staged(ctx, type, tid, event, data, arg)
+#endif // REPLAY_ON
+
+#endif // _REPLAY_H_
@@ -1,242 +1,1315 @@
-/**
- * Martin Egli
- * 2015-09-28
- * scheduler
- * coop scheduler for mcu
- */
-
-// - includes ------------------------------------------------------------------
-//#define DEBUG_PRINTF_ON
-#include "debug_printf.h"
-
-#include "scheduler.h"
-#include <string.h>
-
-// - private variables ---------------------------------------------------------
-static task_t *task_list[NB_OF_TASKS];	// =NULL: unused, free
-static uint8_t task_count;
-static uint8_t tid_count; /// tid == 0 should not exist
-
-// - private (static) functions-------------------------------------------------
-
-/**
- * find the task in the list by given tid
- * find only first occurence
- * @param   tid of task to find
- * @reutn   pointert to task_t   =NULL: could not find task with given tid
- *                                  else: valid pointer
- */
-static task_t *scheduler_find_task_by_tid(uint8_t tid) {
-    uint8_t n;
-	DEBUG_PRINTF_MESSAGE("scheduler_find_task_by_tid(%d)\n", tid);
-    for(n = 0; n < NB_OF_TASKS; n++) {
-        if(task_list[n] != NULL) {
-            if(task_list[n]->tid == tid) {
-                // found task with same tid
-				DEBUG_PRINTF_MESSAGE(" + found: %p\n", task_list[n]);
-                return task_list[n];
-            }
-        }
-    }
-    // no task in list found
-	DEBUG_PRINTF_MESSAGE(" + no task found\n");
-    return NULL;
-}
-
-/**
- * remove a task from task_list given by tid
- * @param   tid of task to remove
- * @return  status =1: successfully removed task from task_list
- *                 =0: could not remove task from task_list
- * /
-static int8_t task_RemoveFromtaskList(uint8_t tid);*/
-
-/**
- * execute a task given by its TID
- * @param	tid		task identifier
- * @param	event	event for the task to execute
- * @param	data	additional data to task (if unused = NULL)
- * @return	status 	=true: OK, could execute task
- *					=false: error, could not execute task
- */
-static int8_t scheduler_exec_task(uint8_t tid, uint8_t event, void *data) {
-    task_t *p;
-	DEBUG_PRINTF_MESSAGE("scheduler_exec_task(tid: %d, event: %d)\n", tid, event);
-    // check if task exists
-    if((p = scheduler_find_task_by_tid(tid)) == NULL) {
-        // error, task does not exist
-        return false;
-    }
-
-   	// is function pointer correctly set?
-	if(p->task == NULL) {
-		// error, function pointer is not set
-		return false;
-	}
-    // check if task is not yet started
-    if(p->state == TASK_STATE_NONE) {
-        // task is not active
-        return false;
-    }
-
-    DEBUG_PRINTF_MESSAGE("execute task \"%s\" (tid: %d, event: %d, data: %p)\n",
-        p->name, p->tid, event, data);
-
-	// OK, execute task
-	p->state = TASK_STATE_RUNNING;
-	if(p->task(event, data) == 0) {
-	    // do not run this task anymore
-		p->state = TASK_STATE_NONE;
-	}
-	else {
-    	// task remains active
-		p->state = TASK_STATE_ACTIVE;
-	}
-	return true;
-}
-
-// - public functions ----------------------------------------------------------
-
-void scheduler_init(void) {
-	// vars
-	task_count = 0;
-	tid_count = 0;  // 1st time: ++
-	memset((uint8_t *)task_list, 0, sizeof(task_list));
-	events_init();
-	power_mode_init();
-}
-
-int8_t scheduler_add_task(task_t *p) {
-    uint8_t n;
-
-	// sanity tests
-	if(p == NULL) {
-		// error, no task
-		return false;
-	}
-	if(p->task == NULL) {
-		// error, no task_function defined
-		return false;
-	}
-
-	// place task in task_list
-	if(task_count >= NB_OF_TASKS) {
-		// error, no more space for an additional task in the task_list
-		return false;
-	}
-    for(n = 0; n < NB_OF_TASKS; n++) {
-        if(task_list[n] == NULL) {
-            // found empty space in task_list
-            break;
-        }
-    }
-    if(n >= NB_OF_TASKS) {
-        // error, could not add task to list, no more space available
-	    return false;
-    }
-
-    // found empty space, add task to task_list
-    task_list[n] = p;
-    task_count++;
-    if(tid_count == 0) {
-        tid_count = 1;
-    }
-    else {
-        tid_count++;
-    }
-    // success, added task to task_list
-    p->tid = tid_count;
-    p->state = TASK_STATE_NONE;
-
-    DEBUG_PRINTF_MESSAGE("task_Add: %s, tid: %d\n",
-    		p->name,
-			p->tid);
-    return true;
-}
-
-int8_t scheduler_remove_task(task_t *p) {
-    // not implemented yet
-    return false;
-}
-
-int8_t scheduler_start_task(uint8_t tid) {
-    task_t *p;
-    // check if task exists
-    if((p = scheduler_find_task_by_tid(tid)) == NULL) {
-        // error, task does not exist
-        return false;
-    }
-    // check if task is already started
-    if(p->state != TASK_STATE_NONE) {
-        // error, task is already started
-        return false;
-    }
-
-	// start task
-	p->state = TASK_STATE_ACTIVE;
-	DEBUG_PRINTF_MESSAGE("task_Start: %s, tid: %d, state: %d\n",
-			p->name,
-			p->tid,
-			p->state);
-	return scheduler_send_event(tid, EV_START, NULL);
-}
-
-int8_t scheduler_stop_task(uint8_t tid) {
-	// not implemented yet
-    return false;
-}
-
-int8_t scheduler_send_event(uint8_t tid, uint8_t event, void *data) {
-	event_t ev;
-	int8_t ret;
-
-	ev.tid = tid;
-	ev.event = event;
-	ev.data = data;
-	ret = events_add_to_main_fifo(&ev);
-	return ret;
-}
-
-int8_t scheduler_is_evvent_main_fifo_empty(void) {
-    return events_is_main_fifo_empty();
-}
-
-int8_t scheduler_start_event_timer(void) {
-	return events_start_timer(0);
-
-}
-
-int8_t scheduler_stop_event_timer(void) {
-	return events_stop_timer();
-}
-
-int8_t scheduler_add_timer_event(uint16_t timeout, uint8_t tid, uint8_t event, void *data) {
-	event_t ev;
-	int8_t ret;
-	uint8_t sr;
-
-	ev.tid = tid;
-	ev.event = event;
-	ev.data = data;
-	lock_interrupt(sr);
-	ret = events_add_single_timer_event(timeout, &ev);
-	restore_interrupt(sr);
-	return ret;
-}
-
-int8_t scheduler_run(void) {
-	static event_t ev;
-	static int8_t ret;
-
-	while(1) {
-		// get next event
-		if((ret = events_get_from_main_fifo(&ev)) == true) {
-			// got a valid event, send it to the task
-			scheduler_exec_task(ev.tid, ev.event, ev.data);
-		}
-		else {
-			power_mode_sleep();
-		}
-	}
-	return false;
-}
+/**
+ * Martin Egli
+ * 2015-09-28
+ * scheduler
+ * coop scheduler for mcu
+ */
+
+// - includes ------------------------------------------------------------------
+//#define DEBUG_PRINTF_ON
+#include "debug_printf.h"
+#include "dlog.h"
+
+#include "scheduler.h"
+#include "events_ext.h"
+#include "events_shm.h"
+#include "replay.h"
+#include "snapshot.h"
+#include <string.h>
+
+// - private variables ---------------------------------------------------------
+// .flags of coalesce_t
+#define COALESCE_USED   (1<<0)
+#define COALESCE_ALWAYS (1<<1)
+
+static scheduler_ctx_t scheduler_default_ctx;
+// instance that runs in this thread, =NULL: none, use scheduler_default_ctx
+static ARCH_THREAD_LOCAL scheduler_ctx_t *scheduler_running_ctx;
+// the only instance that formats the dlog records (single consumer), see scheduler_set_dlog_consumer()
+static scheduler_ctx_t *scheduler_dlog_ctx = &scheduler_default_ctx;
+
+// - private (static) functions-------------------------------------------------
+
+/**
+ * find the task in the list by given tid
+ * find only first occurence
+ * @param   tid of task to find
+ * @reutn   pointert to task_t   =NULL: could not find task with given tid
+ *                                  else: valid pointer
+ */
+static task_t *scheduler_find_task_by_tid(scheduler_ctx_t *ctx, uint8_t tid) {
+    uint8_t n;
+	DEBUG_PRINTF_MESSAGE("scheduler_find_task_by_tid(ctx, %d)\n", tid);
+    if((n = ctx->tid_pos[tid]) < NB_OF_TASKS) {
+        // found task with same tid
+		DEBUG_PRINTF_MESSAGE(" + found: %p\n", ctx->task_list[n]);
+        return ctx->task_list[n];
+    }
+    // no task in list found
+	DEBUG_PRINTF_MESSAGE(" + no task found\n");
+    return NULL;
+}
+
+/**
+ * find the position of a task in task_list by given tid
+ * @param   tid of task to find
+ * @return  position in task_list  =NB_OF_TASKS: could not find task with given tid
+ */
+static uint8_t scheduler_find_pos_by_tid(scheduler_ctx_t *ctx, uint8_t tid) {
+    return ctx->tid_pos[tid];
+}
+
+/**
+ * find the topic of an event code
+ * @param   event   code of the topic
+ * @return  pointer to topic_t  =NULL: nobody subscribed to this event
+ */
+static topic_t *scheduler_find_topic(scheduler_ctx_t *ctx, uint8_t event) {
+    uint8_t n;
+    for(n = 0; n < NB_OF_TOPICS; n++) {
+        if((ctx->topic_list[n].subscribers != 0) && (ctx->topic_list[n].event == event)) {
+            return &ctx->topic_list[n];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * find the index of a coalescing event code, add it if not found
+ * @param   event   code to find
+ * @param   add     =true: add it if not found
+ * @return  index in coalesce_list  =NB_OF_COALESCE_EVENTS: not found, no more space
+ */
+static uint8_t scheduler_find_coalesce(scheduler_ctx_t *ctx, uint8_t event, uint8_t add) {
+    uint8_t n, free = NB_OF_COALESCE_EVENTS;
+    for(n = 0; n < NB_OF_COALESCE_EVENTS; n++) {
+        if(ctx->coalesce_list[n].flags & COALESCE_USED) {
+            if(ctx->coalesce_list[n].event == event) {
+                return n;
+            }
+        }
+        else if(free == NB_OF_COALESCE_EVENTS) {
+            free = n;
+        }
+    }
+    if(add && (free < NB_OF_COALESCE_EVENTS)) {
+        ctx->coalesce_list[free].event = event;
+        ctx->coalesce_list[free].flags = COALESCE_USED;
+    }
+    return free;
+}
+
+/**
+ * remove all queued events and pending timer events of a task
+ * @param   pos     position of the task in task_list
+ */
+static void scheduler_purge_task(scheduler_ctx_t *ctx, uint8_t pos) {
+    uint8_t n, tid = ctx->task_list[pos]->tid;
+    uint16_t sr;
+    lock_interrupt(sr);
+    events_ctx_purge_main_fifo(&ctx->events, tid);
+    events_ctx_purge_timer_events(&ctx->events, tid);
+    // coalesced events of this task are gone from main_fifo
+    for(n = 0; n < NB_OF_COALESCE_EVENTS; n++) {
+        ctx->coalesce_pending[n] &= ~((uint32_t)1 << pos);
+    }
+    restore_interrupt(sr);
+}
+
+#ifdef EVENTS_LATENCY_ON
+/**
+ * add a time to a log2 histogram
+ * @param	ns		time in ns
+ */
+static inline void scheduler_histogram_add(task_histogram_t *h, uint32_t ns) {
+    uint8_t n = 0;
+    while((n < (TASK_HISTOGRAM_NB_OF_BUCKETS - 1)) && (ns >> (n + 1))) {
+        n++;
+    }
+    if(h->count == 0xFFFFFFFF) {
+        // full, start again
+        memset(h, 0, sizeof(*h));
+    }
+    h->bucket[n]++;
+    h->count++;
+}
+
+/**
+ * get a percentile of a log2 histogram
+ * @param	permille	percentile in 1/1000
+ * @return	upper bound of the bucket in ns, =0: no samples
+ */
+static uint32_t scheduler_histogram_percentile(task_histogram_t *h, uint16_t permille) {
+    uint64_t rank, sum = 0;
+    uint8_t n;
+    if(h->count == 0) {
+        return 0;
+    }
+    // the sample at rank, rounded up, e.g. p999 of 100 samples is the largest
+    rank = ((uint64_t)h->count * permille + 999) / 1000;
+    for(n = 0; n < TASK_HISTOGRAM_NB_OF_BUCKETS; n++) {
+        sum += h->bucket[n];
+        if((sum >= rank) && sum) {
+            break;
+        }
+    }
+    if(n >= (TASK_HISTOGRAM_NB_OF_BUCKETS - 1)) {
+        return 0xFFFFFFFF;
+    }
+    return ((uint32_t)2 << n) - 1;
+}
+#endif // EVENTS_LATENCY_ON
+
+/**
+ * execute a given task
+ * @param	p		pointer to task context
+ * @param	event	event for the task to execute
+ * @param	data	additional data to task (if unused = NULL)
+ * @param	batch	events for the batch handler of the task, =NULL: call the task with event, data
+ * @param	count	number of events in batch
+ * @return	status 	=true: OK, could execute task
+ *					=false: error, could not execute task
+ */
+static int8_t scheduler_exec_task_p(scheduler_ctx_t *ctx, task_t *p, uint8_t event, void *data, event_t *batch, uint16_t count) {
+    uint64_t start, runtime;
+    uint32_t budget;
+    int8_t ret;
+
+   	// is function pointer correctly set?
+	if(p->task == NULL) {
+		// error, function pointer is not set
+		return false;
+	}
+    // check if task is not yet started
+    if(p->state == TASK_STATE_NONE) {
+        // task is not active
+        return false;
+    }
+
+    DLOG_DEBUG("execute task (tid: %llu, event: %llu, data: 0x%llx)\n",
+        p->tid, event, (uintptr_t)data);
+
+	// OK, execute task
+	if(ctx->event_count == 0) {
+		ctx->event_count = 1;
+	}
+	budget = p->budget_ns ? p->budget_ns : SCHEDULER_TASK_BUDGET_NS;
+	start = events_ctx_get_clock_ns(&ctx->events);
+	ctx->yield_deadline_ns = budget ? (start + budget) : UINT64_MAX;
+	ctx->current_task = p;
+	p->state = TASK_STATE_RUNNING;
+	if(batch != NULL) {
+		ret = p->batch(batch, count);
+	}
+	else {
+		ret = p->task(event, data);
+	}
+	runtime = events_ctx_get_clock_ns(&ctx->events) - start;
+	ctx->current_task = NULL;
+	ctx->yield_deadline_ns = UINT64_MAX;
+#ifdef EVENTS_LATENCY_ON
+	if(ctx->dispatch_stamped) {
+		// queueing delay until this call (later subscribers of a published event wait longer)
+		scheduler_histogram_add(&p->queue_delay, (uint32_t)start - ctx->dispatch_stamp);
+		scheduler_histogram_add(&p->exec_time, (runtime > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t)runtime);
+	}
+#endif
+	if(ret == 0) {
+	    // do not run this task anymore
+		if(p->state == TASK_STATE_RUNNING) {
+			scheduler_ctx_stop_task(ctx, p->tid);
+		}
+	}
+	else if(p->state == TASK_STATE_RUNNING) {
+    	// task remains active (if it did not stop itself)
+		p->state = TASK_STATE_ACTIVE;
+	}
+	ctx->event_count = 0;
+
+	// measure runtime, find overruns
+	if(runtime > 0xFFFFFFFF) {
+		runtime = 0xFFFFFFFF;
+	}
+	if(runtime > p->runtime_max_ns) {
+		p->runtime_max_ns = runtime;
+	}
+	if(budget && (runtime > budget)) {
+		DLOG_WARN("task overrun (tid: %llu, event: %llu, runtime: %llu ns)\n",
+			p->tid, event, runtime);
+		if(p->overruns < 0xFFFF) {
+			p->overruns++;
+		}
+		p->overrun_event = event;
+		if(ctx->overrun_hook != NULL) {
+			ctx->overrun_hook(p, event, (uint32_t)runtime);
+		}
+	}
+	return true;
+}
+
+/**
+ * add an event to the fifo of the event group of its task
+ * events to unknown tids (publish, deferred calls) go to the main_fifo (group 0)
+ * @param	ev		event to add
+ * @return	status 	=true: OK, =false: error, the fifo is full
+ */
+static int8_t scheduler_add_event(scheduler_ctx_t *ctx, event_t *ev) {
+    task_t *p;
+    uint8_t group = 0;
+    if((p = scheduler_find_task_by_tid(ctx, ev->tid)) != NULL) {
+        group = p->group;
+    }
+    return events_ctx_add_to_group_fifo(&ctx->events, group, ev);
+}
+
+/**
+ * get the next event from the fifos of the event groups, deficit round robin
+ * a group dispatches up to its weight in events per turn, then the next group
+ * with events takes its turn, an empty group loses the rest of its turn
+ * @param	ev		pointer to store the event
+ * @return	=true: OK, ev is valid, =false: no events
+ */
+static int8_t scheduler_get_next_event(scheduler_ctx_t *ctx, event_t *ev) {
+    uint8_t n, group;
+    // the current group, then every group once with a new turn
+    for(n = 0; n <= EVENTS_NB_OF_GROUPS; n++) {
+        group = ctx->group_next;
+        if(ctx->group_deficit[group] && (events_ctx_get_from_group_fifo(&ctx->events, group, ev) == true)) {
+            ctx->group_deficit[group]--;
+            return true;
+        }
+        ctx->group_deficit[group] = 0;
+        if(++group >= EVENTS_NB_OF_GROUPS) {
+            group = 0;
+        }
+        ctx->group_next = group;
+        ctx->group_deficit[group] = ctx->group_weight[group];
+    }
+    return false;
+}
+
+/**
+ * take a coalesced event from the coalescing tables, it is not pending anymore
+ * @param	ev		coalesced event from main_fifo
+ * @param	count	pointer to store the number of coalesced sends, =0: error, =NULL: not needed
+ * @return	latest data of the coalesced event
+ */
+static void *scheduler_take_coalesced(scheduler_ctx_t *ctx, event_t *ev, uint16_t *count) {
+    void *data;
+    uint8_t pos, idx;
+    uint16_t sr;
+
+    if(count != NULL) {
+        *count = 0;
+    }
+    if(((pos = scheduler_find_pos_by_tid(ctx, ev->tid)) >= NB_OF_TASKS) ||
+       ((idx = scheduler_find_coalesce(ctx, ev->event, false)) >= NB_OF_COALESCE_EVENTS)) {
+        return NULL;
+    }
+    lock_interrupt(sr);
+    // not pending anymore, the task may send this event again while executing
+    ctx->coalesce_pending[idx] &= ~((uint32_t)1 << pos);
+    data = ctx->coalesce_data[idx][pos];
+    if(count != NULL) {
+        *count = ctx->coalesce_count[idx][pos];
+    }
+    restore_interrupt(sr);
+    return data;
+}
+
+/**
+ * execute a task given by its TID
+ * @param	tid		task identifier
+ * @param	event	event for the task to execute
+ * @param	data	additional data to task (if unused = NULL)
+ * @return	status 	=true: OK, could execute task
+ *					=false: error, could not execute task
+ */
+static int8_t scheduler_exec_task(scheduler_ctx_t *ctx, uint8_t tid, uint8_t event, void *data) {
+    event_t batch[NB_OF_BATCH_EVENTS];
+    uint16_t n, count;
+    task_t *p;
+    // check if task exists
+    if((p = scheduler_find_task_by_tid(ctx, tid)) == NULL) {
+        // error, task does not exist
+        return false;
+    }
+    if((p->batch == NULL) || (p->state == TASK_STATE_NONE)) {
+        return scheduler_exec_task_p(ctx, p, event, data, NULL, 0);
+    }
+    // batch handler: this event and all other pending events of this task at once
+    batch[0].tid = tid;
+    batch[0].event = event;
+    batch[0].data = EVENT_DATA_PACK(data);
+    batch[0].flags = 0;
+    count = 1 + events_ctx_take_from_main_fifo(&ctx->events, tid, &batch[1], NB_OF_BATCH_EVENTS - 1);
+    for(n = 1; n < count; n++) {
+        if(batch[n].flags & EV_FLAG_COALESCED) {
+            // get the latest data of a coalesced event
+            batch[n].data = EVENT_DATA_PACK(scheduler_take_coalesced(ctx, &batch[n], NULL));
+            batch[n].flags = 0;
+        }
+    }
+    return scheduler_exec_task_p(ctx, p, event, data, batch, count);
+}
+
+/**
+ * deliver a published event to all subscribed tasks
+ * @param	event	published event
+ * @param	data	additional data to tasks (if unused = NULL)
+ * @return	status 	=true: OK, delivered to at least 1 task
+ *					=false: error, no subscribers
+ */
+static int8_t scheduler_exec_publish(scheduler_ctx_t *ctx, uint8_t event, void *data) {
+    topic_t *t;
+    uint32_t subscribers;
+    uint8_t n;
+    int8_t ret = false;
+	DLOG_DEBUG("scheduler_exec_publish(event: %llu)\n", event);
+    if((t = scheduler_find_topic(ctx, event)) == NULL) {
+        // nobody subscribed (anymore)
+        return false;
+    }
+    // copy, a task may (un)subscribe while executing
+    subscribers = t->subscribers;
+    for(n = 0; subscribers != 0; n++, subscribers >>= 1) {
+        if((subscribers & 1) && (ctx->task_list[n] != NULL)) {
+            if(scheduler_exec_task_p(ctx, ctx->task_list[n], event, data, NULL, 0) == true) {
+                ret = true;
+            }
+        }
+    }
+    return ret;
+}
+
+/**
+ * execute a coalesced event, get its latest data and count
+ * @param	ev		coalesced event from main_fifo
+ * @return	status 	=true: OK, could execute task
+ *					=false: error, could not execute task
+ */
+static int8_t scheduler_exec_coalesced(scheduler_ctx_t *ctx, event_t *ev) {
+    void *data;
+    uint8_t pos;
+    uint16_t count;
+    int8_t ret;
+
+    if((pos = scheduler_find_pos_by_tid(ctx, ev->tid)) >= NB_OF_TASKS) {
+        // error, task does not exist (anymore)
+        return false;
+    }
+    data = scheduler_take_coalesced(ctx, ev, &count);
+    if(count == 0) {
+        return false;
+    }
+    ctx->event_count = count;
+    ret = scheduler_exec_task_p(ctx, ctx->task_list[pos], ev->event, data, NULL, 0);
+    ctx->event_count = 0;
+    return ret;
+}
+
+/**
+ * take a free deferred call and fill it in
+ * @param	func	function to call
+ * @param	arg		argument to func
+ * @return	position in defer_list  =NB_OF_DEFER_CALLS: no more free deferred calls
+ */
+static uint8_t scheduler_alloc_defer(scheduler_ctx_t *ctx, scheduler_defer_func_t func, void *arg) {
+    uint8_t n;
+    uint16_t sr;
+
+    lock_interrupt(sr);
+    if(ctx->defer_free_count == 0) {
+        restore_interrupt(sr);
+        return NB_OF_DEFER_CALLS;
+    }
+    n = ctx->defer_free[--ctx->defer_free_count];
+    restore_interrupt(sr);
+    ctx->defer_list[n].func = func;
+    ctx->defer_list[n].arg = arg;
+    return n;
+}
+
+/**
+ * free a deferred call
+ * @param	n		position in defer_list
+ */
+static void scheduler_free_defer(scheduler_ctx_t *ctx, uint8_t n) {
+    uint16_t sr;
+    lock_interrupt(sr);
+    ctx->defer_list[n].func = NULL;
+    ctx->defer_free[ctx->defer_free_count++] = n;
+    restore_interrupt(sr);
+}
+
+/**
+ * execute a deferred call, it is free again before the function is called
+ * @param	n		position in defer_list, from the event data
+ * @return	status 	=true: OK, function was called
+ *					=false: error, invalid deferred call
+ */
+static int8_t scheduler_exec_defer(scheduler_ctx_t *ctx, uint8_t n) {
+    scheduler_defer_func_t func;
+    void *arg;
+
+    if((n >= NB_OF_DEFER_CALLS) || ((func = ctx->defer_list[n].func) == NULL)) {
+        return false;
+    }
+    arg = ctx->defer_list[n].arg;
+    // the function may defer itself again
+    scheduler_free_defer(ctx, n);
+    func(arg);
+    return true;
+}
+
+/**
+ * run 1 slice of the next idle task (round robin)
+ * @return	status 	=true: an idle task was executed
+ *					=false: no idle tasks
+ */
+static int8_t scheduler_run_idle_task(scheduler_ctx_t *ctx) {
+    task_t *p;
+    uint8_t n, pos;
+    int8_t ret;
+
+    for(n = 0; n < NB_OF_IDLE_TASKS; n++) {
+        pos = ctx->idle_next;
+        ctx->idle_next++;
+        if(ctx->idle_next >= NB_OF_IDLE_TASKS) {
+            ctx->idle_next = 0;
+        }
+        if((p = ctx->idle_list[pos]) == NULL) {
+            continue;
+        }
+        // host port: due timer events come first
+        events_ctx_timer_poll(&ctx->events);
+        if(events_ctx_is_main_fifo_empty(&ctx->events) == false) {
+            return true;
+        }
+        DEBUG_PRINTF_MESSAGE("execute idle task \"%s\"\n", p->name);
+        ctx->yield_deadline_ns = events_ctx_get_clock_ns(&ctx->events) + ctx->idle_budget_ns;
+        ctx->current_task = p;
+        p->state = TASK_STATE_RUNNING;
+        ret = p->task(EV_IDLE, NULL);
+        ctx->current_task = NULL;
+        ctx->yield_deadline_ns = UINT64_MAX;
+        if(ret == 0) {
+            // background work is done, remove idle task
+            p->state = TASK_STATE_NONE;
+            ctx->idle_list[pos] = NULL;
+            if(ctx->idle_added & (1 << pos)) {
+                // its tid was only for the idle work
+                ctx->idle_added &= ~(1 << pos);
+                scheduler_ctx_remove_task(ctx, p);
+            }
+        }
+        else {
+            p->state = TASK_STATE_ACTIVE;
+        }
+        return true;
+    }
+    return false;
+}
+
+// - public functions ----------------------------------------------------------
+
+void scheduler_ctx_init(scheduler_ctx_t *ctx) {
+	// vars
+	ctx->task_count = 0;
+	ctx->tid_count = 0;  // 1st time: ++
+	memset((uint8_t *)ctx->task_list, 0, sizeof(ctx->task_list));
+	memset(ctx->tid_pos, NB_OF_TASKS, sizeof(ctx->tid_pos));
+	// 1st free position on top
+	for(ctx->task_free_count = 0; ctx->task_free_count < NB_OF_TASKS; ctx->task_free_count++) {
+		ctx->task_free[ctx->task_free_count] = NB_OF_TASKS - 1 - ctx->task_free_count;
+	}
+	memset(ctx->topic_list, 0, sizeof(ctx->topic_list));
+	memset(ctx->coalesce_list, 0, sizeof(ctx->coalesce_list));
+	memset(ctx->coalesce_always_map, 0, sizeof(ctx->coalesce_always_map));
+	memset(ctx->coalesce_pending, 0, sizeof(ctx->coalesce_pending));
+	ctx->event_count = 0;
+	memset(ctx->idle_list, 0, sizeof(ctx->idle_list));
+	ctx->idle_next = 0;
+	ctx->idle_added = 0;
+	ctx->idle_budget_ns = SCHEDULER_IDLE_BUDGET_NS;
+	ctx->current_task = NULL;
+	ctx->yield_deadline_ns = UINT64_MAX;
+	ctx->overrun_hook = NULL;
+	memset(ctx->defer_list, 0, sizeof(ctx->defer_list));
+	for(ctx->defer_free_count = 0; ctx->defer_free_count < NB_OF_DEFER_CALLS; ctx->defer_free_count++) {
+		ctx->defer_free[ctx->defer_free_count] = NB_OF_DEFER_CALLS - 1 - ctx->defer_free_count;
+	}
+	memset(ctx->group_weight, 1, sizeof(ctx->group_weight));
+	memset(ctx->group_deficit, 0, sizeof(ctx->group_deficit));
+	ctx->group_next = 0;
+	ctx->group_deficit[0] = ctx->group_weight[0];
+#ifdef EVENTS_LATENCY_ON
+	ctx->dispatch_stamped = false;
+#endif
+#ifdef SNAPSHOT_ON
+	ctx->snapshot = NULL;	// close it before a re-init, see snapshot_close()
+#endif
+#ifdef EVENTS_SHM_ON
+	ctx->shm = NULL;	// destroy it before a re-init, see events_shm_destroy()
+#endif
+#ifdef REPLAY_ON
+	ctx->replay_file = NULL;	// stop it before a re-init, see replay_record_stop()
+	ctx->dispatching = false;
+#endif
+	events_ctx_init(&ctx->events, ctx);
+	events_ext_ctx_init(&ctx->ext, ctx);
+}
+
+void scheduler_ctx_destroy(scheduler_ctx_t *ctx) {
+	(void)ctx; // not used without EVENTS_EXT_ON, REPLAY_ON, SNAPSHOT_ON and EVENTS_SHM_ON
+#ifdef REPLAY_ON
+	replay_ctx_record_stop(ctx);
+#endif
+#ifdef SNAPSHOT_ON
+	snapshot_ctx_close(ctx);
+#endif
+#ifdef EVENTS_SHM_ON
+	events_shm_ctx_destroy(ctx);
+#endif
+	events_ext_ctx_destroy(&ctx->ext);
+}
+
+int8_t scheduler_ctx_add_task(scheduler_ctx_t *ctx, task_t *p) {
+    uint8_t n;
+
+	// sanity tests
+	if(p == NULL) {
+		// error, no task
+		return false;
+	}
+	if(p->task == NULL) {
+		// error, no task_function defined
+		return false;
+	}
+	if(p->group >= EVENTS_NB_OF_GROUPS) {
+		// error, no such event group
+		return false;
+	}
+
+	// place task in task_list
+	if((ctx->task_count >= NB_OF_TASKS) || (ctx->task_free_count == 0)) {
+		// error, no more space for an additional task in the task_list
+		return false;
+	}
+    // take a free position, no need to search
+    n = ctx->task_free[--ctx->task_free_count];
+
+    // found empty space, add task to task_list
+    ctx->task_list[n] = p;
+    ctx->task_count++;
+    // next unused tid, tid == 0 does not exist, tids of removed tasks get reused after wrap arround
+    do {
+        ctx->tid_count++;
+    } while((ctx->tid_count == SCHEDULER_TID_PUBLISH) || (ctx->tid_count == SCHEDULER_TID_DEFER) ||
+            (ctx->tid_pos[ctx->tid_count] < NB_OF_TASKS));
+    // success, added task to task_list
+    p->tid = ctx->tid_count;
+    p->state = TASK_STATE_NONE;
+    ctx->tid_pos[p->tid] = n;
+
+    DEBUG_PRINTF_MESSAGE("task_Add: %s, tid: %d\n",
+    		p->name,
+			p->tid);
+    return true;
+}
+
+int8_t scheduler_ctx_remove_task(scheduler_ctx_t *ctx, task_t *p) {
+    uint8_t n, pos;
+
+    if(p == NULL) {
+        // error, no task
+        return false;
+    }
+    if(((pos = scheduler_find_pos_by_tid(ctx, p->tid)) >= NB_OF_TASKS) || (ctx->task_list[pos] != p)) {
+        // error, task is not in task_list
+        return false;
+    }
+    if(p->state != TASK_STATE_NONE) {
+        scheduler_ctx_stop_task(ctx, p->tid);
+    }
+    else {
+        // not started, but there could be events already
+        scheduler_purge_task(ctx, pos);
+    }
+    for(n = 0; n < NB_OF_TOPICS; n++) {
+        ctx->topic_list[n].subscribers &= ~((uint32_t)1 << pos);
+    }
+    // free position in task_list, can be reused right away
+    ctx->task_list[pos] = NULL;
+    ctx->tid_pos[p->tid] = NB_OF_TASKS;
+    ctx->task_free[ctx->task_free_count++] = pos;
+    ctx->task_count--;
+    DEBUG_PRINTF_MESSAGE("task_Remove: %s, tid: %d\n", p->name, p->tid);
+    return true;
+}
+
+int8_t scheduler_ctx_start_task(scheduler_ctx_t *ctx, uint8_t tid) {
+    task_t *p;
+    // check if task exists
+    if((p = scheduler_find_task_by_tid(ctx, tid)) == NULL) {
+        // error, task does not exist
+        return false;
+    }
+    // check if task is already started
+    if(p->state != TASK_STATE_NONE) {
+        // error, task is already started
+        return false;
+    }
+
+	// start task
+	p->state = TASK_STATE_ACTIVE;
+	DEBUG_PRINTF_MESSAGE("task_Start: %s, tid: %d, state: %d\n",
+			p->name,
+			p->tid,
+			p->state);
+	return scheduler_ctx_send_event(ctx, tid, EV_START, NULL);
+}
+
+int8_t scheduler_ctx_stop_task(scheduler_ctx_t *ctx, uint8_t tid) {
+    task_t *p;
+    uint8_t pos;
+    // check if task exists
+    if((pos = scheduler_find_pos_by_tid(ctx, tid)) >= NB_OF_TASKS) {
+        // error, task does not exist
+        return false;
+    }
+    p = ctx->task_list[pos];
+    // check if task is already stopped
+    if(p->state == TASK_STATE_NONE) {
+        // error, task is not started
+        return false;
+    }
+    if(p->state == TASK_STATE_ACTIVE) {
+        // let the task clean up, (not if it stops itself while running)
+        p->state = TASK_STATE_RUNNING;
+        p->task(EV_STOP, NULL);
+    }
+	// stop task, its queued events and timer events are not needed anymore
+	p->state = TASK_STATE_NONE;
+	scheduler_purge_task(ctx, pos);
+	DEBUG_PRINTF_MESSAGE("task_Stop: %s, tid: %d\n", p->name, p->tid);
+    return true;
+}
+
+int8_t scheduler_ctx_add_idle_task(scheduler_ctx_t *ctx, task_t *p) {
+	uint8_t n;
+
+	// sanity tests
+	if((p == NULL) || (p->task == NULL)) {
+		// error, no task or no task_function defined
+		return false;
+	}
+	for(n = 0; n < NB_OF_IDLE_TASKS; n++) {
+		if(ctx->idle_list[n] == NULL) {
+			if(scheduler_find_task_by_tid(ctx, p->tid) != p) {
+				// not in task_list, take a tid (scheduler_get_current_tid(), channel waiters)
+				if(scheduler_ctx_add_task(ctx, p) == false) {
+					return false;
+				}
+				ctx->idle_added |= (1 << n);
+			}
+			ctx->idle_list[n] = p;
+			p->state = TASK_STATE_ACTIVE;
+			DEBUG_PRINTF_MESSAGE("idle_task_Add: %s\n", p->name);
+			return true;
+		}
+	}
+	// error, no more space for an additional idle task
+	return false;
+}
+
+void scheduler_ctx_set_idle_budget(scheduler_ctx_t *ctx, uint32_t budget_ns) {
+	ctx->idle_budget_ns = budget_ns;
+}
+
+int8_t scheduler_ctx_idle_should_yield(scheduler_ctx_t *ctx) {
+	events_ctx_timer_poll(&ctx->events); // host port: a due timer event is an event too
+	if((events_ctx_is_main_fifo_empty(&ctx->events) == false) || events_ext_ctx_is_pending(&ctx->ext) ||
+	   events_shm_ctx_is_pending(ctx) || events_ctx_is_timer_stage_pending(&ctx->events)) {
+		// an event arrived (or a timer request from an ISR), it has priority
+		return true;
+	}
+	// budget of this slice is used up?
+	return scheduler_ctx_should_yield(ctx);
+}
+
+int8_t scheduler_ctx_set_task_budget(scheduler_ctx_t *ctx, uint8_t tid, uint32_t budget_ns) {
+	task_t *p;
+	if((p = scheduler_find_task_by_tid(ctx, tid)) == NULL) {
+		// error, task does not exist
+		return false;
+	}
+	p->budget_ns = budget_ns;
+	return true;
+}
+
+#ifdef EVENTS_LATENCY_ON
+uint32_t scheduler_ctx_get_task_latency(scheduler_ctx_t *ctx, uint8_t tid, uint8_t which, uint16_t permille) {
+	task_t *p;
+	if((p = scheduler_find_task_by_tid(ctx, tid)) == NULL) {
+		// error, task does not exist
+		return 0;
+	}
+	if(permille > 1000) {
+		permille = 1000;
+	}
+	return scheduler_histogram_percentile((which == SCHEDULER_LATENCY_EXEC) ? &p->exec_time : &p->queue_delay, permille);
+}
+
+int8_t scheduler_ctx_reset_task_latency(scheduler_ctx_t *ctx, uint8_t tid) {
+	task_t *p;
+	if((p = scheduler_find_task_by_tid(ctx, tid)) == NULL) {
+		// error, task does not exist
+		return false;
+	}
+	memset(&p->queue_delay, 0, sizeof(p->queue_delay));
+	memset(&p->exec_time, 0, sizeof(p->exec_time));
+	return true;
+}
+#endif // EVENTS_LATENCY_ON
+
+int8_t scheduler_ctx_set_task_group(scheduler_ctx_t *ctx, uint8_t tid, uint8_t group) {
+	task_t *p;
+	if(((p = scheduler_find_task_by_tid(ctx, tid)) == NULL) || (p->state != TASK_STATE_NONE) ||
+	   (group >= EVENTS_NB_OF_GROUPS)) {
+		// error, task does not exist, is started (could have events in its group) or no such group
+		return false;
+	}
+	p->group = group;
+	return true;
+}
+
+int8_t scheduler_ctx_set_group_weight(scheduler_ctx_t *ctx, uint8_t group, uint8_t weight) {
+	if((group >= EVENTS_NB_OF_GROUPS) || (weight == 0)) {
+		return false;
+	}
+	ctx->group_weight[group] = weight;
+	return true;
+}
+
+void scheduler_ctx_set_overrun_hook(scheduler_ctx_t *ctx, scheduler_overrun_hook_t hook) {
+	ctx->overrun_hook = hook;
+}
+
+int8_t scheduler_ctx_should_yield(scheduler_ctx_t *ctx) {
+	if(events_ctx_get_clock_ns(&ctx->events) >= ctx->yield_deadline_ns) {
+		return true;
+	}
+	return false;
+}
+
+uint8_t scheduler_ctx_get_current_tid(scheduler_ctx_t *ctx) {
+	if(ctx->current_task == NULL) {
+		return 0;
+	}
+	return ctx->current_task->tid;
+}
+
+int8_t scheduler_ctx_send_event(scheduler_ctx_t *ctx, uint8_t tid, uint8_t event, void *data) {
+	event_t ev;
+	int8_t ret;
+
+	if(ctx->coalesce_always_map[event >> 3] & (1 << (event & 0x07))) {
+		// this event code is always coalesced
+		return scheduler_ctx_send_event_coalesced(ctx, tid, event, data);
+	}
+	replay_ctx_record(ctx, REPLAY_SEND, tid, event, data, 0);
+	ev.tid = tid;
+	ev.event = event;
+	ev.data = EVENT_DATA_PACK(data);
+	ev.flags = 0;
+	ret = scheduler_add_event(ctx, &ev);
+	return ret;
+}
+
+int8_t scheduler_ctx_send_event_coalesced(scheduler_ctx_t *ctx, uint8_t tid, uint8_t event, void *data) {
+	event_t ev;
+	uint8_t pos, idx;
+	uint16_t sr;
+
+	replay_ctx_record(ctx, REPLAY_SEND_COALESCED, tid, event, data, 0);
+	ev.tid = tid;
+	ev.event = event;
+	ev.data = EVENT_DATA_PACK(data);
+	ev.flags = 0;
+	if(((pos = scheduler_find_pos_by_tid(ctx, tid)) >= NB_OF_TASKS) ||
+	   ((idx = scheduler_find_coalesce(ctx, event, true)) >= NB_OF_COALESCE_EVENTS)) {
+		// unknown task or no more coalescing event codes, send as usual
+		return scheduler_add_event(ctx, &ev);
+	}
+	lock_interrupt(sr);
+	if(ctx->coalesce_pending[idx] & ((uint32_t)1 << pos)) {
+		// already pending, only update data and count
+		ctx->coalesce_data[idx][pos] = data;
+		if(ctx->coalesce_count[idx][pos] < 0xFFFF) {
+			ctx->coalesce_count[idx][pos]++;
+		}
+		restore_interrupt(sr);
+		return true;
+	}
+	ev.flags = EV_FLAG_COALESCED;
+	if(scheduler_add_event(ctx, &ev) == false) {
+		// error, main_fifo is full
+		restore_interrupt(sr);
+		return false;
+	}
+	ctx->coalesce_pending[idx] |= ((uint32_t)1 << pos);
+	ctx->coalesce_data[idx][pos] = data;
+	ctx->coalesce_count[idx][pos] = 1;
+	restore_interrupt(sr);
+	return true;
+}
+
+int8_t scheduler_ctx_set_event_coalescing(scheduler_ctx_t *ctx, uint8_t event, uint8_t on) {
+	uint8_t idx;
+	if((idx = scheduler_find_coalesce(ctx, event, true)) >= NB_OF_COALESCE_EVENTS) {
+		// error, no more coalescing event codes
+		return false;
+	}
+	if(on) {
+		ctx->coalesce_list[idx].flags |= COALESCE_ALWAYS;
+		ctx->coalesce_always_map[event >> 3] |= (1 << (event & 0x07));
+	}
+	else {
+		ctx->coalesce_list[idx].flags &= ~COALESCE_ALWAYS;
+		ctx->coalesce_always_map[event >> 3] &= ~(1 << (event & 0x07));
+	}
+	return true;
+}
+
+uint16_t scheduler_ctx_get_event_count(scheduler_ctx_t *ctx) {
+	return ctx->event_count;
+}
+
+int8_t scheduler_ctx_is_event_main_fifo_empty(scheduler_ctx_t *ctx) {
+    return events_ctx_is_main_fifo_empty(&ctx->events);
+}
+
+int8_t scheduler_ctx_subscribe(scheduler_ctx_t *ctx, uint8_t tid, uint8_t event) {
+	topic_t *t;
+	uint8_t pos, n;
+
+	if((pos = scheduler_find_pos_by_tid(ctx, tid)) >= NB_OF_TASKS) {
+		// error, task does not exist
+		return false;
+	}
+	if((t = scheduler_find_topic(ctx, event)) == NULL) {
+		// new topic, find a free one
+		for(n = 0; n < NB_OF_TOPICS; n++) {
+			if(ctx->topic_list[n].subscribers == 0) {
+				t = &ctx->topic_list[n];
+				t->event = event;
+				break;
+			}
+		}
+		if(t == NULL) {
+			// error, no more free topics
+			return false;
+		}
+	}
+	t->subscribers |= ((uint32_t)1 << pos);
+	DEBUG_PRINTF_MESSAGE("scheduler_subscribe(tid: %d, event: %d), subscribers: 0x%08X\n", tid, event, t->subscribers);
+	return true;
+}
+
+int8_t scheduler_ctx_unsubscribe(scheduler_ctx_t *ctx, uint8_t tid, uint8_t event) {
+	topic_t *t;
+	uint8_t pos;
+
+	if((pos = scheduler_find_pos_by_tid(ctx, tid)) >= NB_OF_TASKS) {
+		// error, task does not exist
+		return false;
+	}
+	if((t = scheduler_find_topic(ctx, event)) == NULL) {
+		// error, nobody subscribed to this event
+		return false;
+	}
+	if((t->subscribers & ((uint32_t)1 << pos)) == 0) {
+		// error, task was not subscribed
+		return false;
+	}
+	// topic is free again if this was the last subscriber
+	t->subscribers &= ~((uint32_t)1 << pos);
+	return true;
+}
+
+int8_t scheduler_ctx_publish(scheduler_ctx_t *ctx, uint8_t event, void *data) {
+	if(scheduler_find_topic(ctx, event) == NULL) {
+		// nobody subscribed, nothing to do
+		return true;
+	}
+	// only 1 slot in main_fifo, fan out when dispatched
+	return scheduler_ctx_send_event(ctx, SCHEDULER_TID_PUBLISH, event, data);
+}
+
+int8_t scheduler_ctx_defer(scheduler_ctx_t *ctx, scheduler_defer_func_t func, void *arg) {
+	event_t ev;
+	uint8_t n;
+
+	if(func == NULL) {
+		return false;
+	}
+	if((n = scheduler_alloc_defer(ctx, func, arg)) >= NB_OF_DEFER_CALLS) {
+		// error, no more free deferred calls
+		return false;
+	}
+	// no task and no tid lookup, the event only carries the position in defer_list
+	ev.tid = SCHEDULER_TID_DEFER;
+	ev.event = 0;
+	ev.data = EVENT_DATA_PACK((void *)(uintptr_t)n);
+	ev.flags = 0;
+	if(events_ctx_add_to_main_fifo(&ctx->events, &ev) == false) {
+		scheduler_free_defer(ctx, n);
+		return false;
+	}
+	return true;
+}
+
+int8_t scheduler_ctx_defer_after(scheduler_ctx_t *ctx, uint32_t timeout, scheduler_defer_func_t func, void *arg) {
+	event_t ev;
+	uint16_t sr;
+	uint8_t n;
+	int8_t ret;
+
+	if(func == NULL) {
+		return false;
+	}
+	if((n = scheduler_alloc_defer(ctx, func, arg)) >= NB_OF_DEFER_CALLS) {
+		// error, no more free deferred calls
+		return false;
+	}
+	// straight to the events, a function pointer can not be recorded for a replay
+	ev.tid = SCHEDULER_TID_DEFER;
+	ev.event = 0;
+	ev.data = EVENT_DATA_PACK((void *)(uintptr_t)n);
+	ev.flags = 0;
+	lock_interrupt(sr);
+	ret = events_ctx_add_single_timer_event(&ctx->events, timeout, &ev);
+	restore_interrupt(sr);
+	if(ret == false) {
+		scheduler_free_defer(ctx, n);
+		return false;
+	}
+	return true;
+}
+
+void scheduler_ctx_cancel_defer(scheduler_ctx_t *ctx, uint8_t n) {
+	if((n < NB_OF_DEFER_CALLS) && (ctx->defer_list[n].func != NULL)) {
+		scheduler_free_defer(ctx, n);
+	}
+}
+
+int8_t scheduler_ctx_start_event_timer(scheduler_ctx_t *ctx) {
+	return events_ctx_start_timer(&ctx->events, 0);
+
+}
+
+int8_t scheduler_ctx_stop_event_timer(scheduler_ctx_t *ctx) {
+	return events_ctx_stop_timer(&ctx->events);
+}
+
+int8_t scheduler_ctx_add_timer_event(scheduler_ctx_t *ctx, uint32_t timeout, uint8_t tid, uint8_t event, void *data) {
+	event_t ev;
+	int8_t ret;
+	uint8_t sr;
+
+	ev.tid = tid;
+	ev.event = event;
+	ev.data = EVENT_DATA_PACK(data);
+	ev.flags = 0;
+	replay_ctx_record(ctx, REPLAY_ARM, tid, event, data, timeout);
+	lock_interrupt(sr);
+	ret = events_ctx_add_single_timer_event(&ctx->events, timeout, &ev);
+	restore_interrupt(sr);
+	return ret;
+}
+
+int8_t scheduler_ctx_add_timer_event_at(scheduler_ctx_t *ctx, uint64_t deadline, uint8_t tid, uint8_t event, void *data) {
+	event_t ev;
+	int8_t ret;
+	uint8_t sr;
+
+	ev.tid = tid;
+	ev.event = event;
+	ev.data = EVENT_DATA_PACK(data);
+	ev.flags = 0;
+	replay_ctx_record(ctx, REPLAY_ARM_AT, tid, event, data, deadline);
+	lock_interrupt(sr);
+	ret = events_ctx_add_single_timer_event_at(&ctx->events, deadline, &ev);
+	restore_interrupt(sr);
+	return ret;
+}
+
+int8_t scheduler_ctx_add_timer_event_from_isr(scheduler_ctx_t *ctx, uint32_t timeout, uint8_t tid, uint8_t event, void *data) {
+	event_t ev;
+
+	ev.tid = tid;
+	ev.event = event;
+	ev.data = EVENT_DATA_PACK(data);
+	ev.flags = 0;
+	// no interrupt lock, merged by scheduler_ctx_run_once()
+	return events_ctx_stage_single_timer_event(&ctx->events, timeout, &ev);
+}
+
+uint16_t scheduler_ctx_cancel_timer_events(scheduler_ctx_t *ctx, uint8_t tid, uint8_t event) {
+	replay_ctx_record(ctx, REPLAY_CANCEL, tid, event, NULL, 0);
+	return events_ctx_cancel_timer_events(&ctx->events, tid, event);
+}
+
+int8_t scheduler_ctx_cancel_timer_events_from_isr(scheduler_ctx_t *ctx, uint8_t tid, uint8_t event) {
+	return events_ctx_stage_cancel_timer_events(&ctx->events, tid, event);
+}
+
+uint64_t scheduler_ctx_get_time_ticks(scheduler_ctx_t *ctx) {
+	return events_ctx_get_time_ticks(&ctx->events);
+}
+
+uint64_t scheduler_ctx_get_time_ns(scheduler_ctx_t *ctx) {
+	return events_ctx_get_time_ns(&ctx->events);
+}
+
+int8_t scheduler_ctx_run_once(scheduler_ctx_t *ctx) {
+	scheduler_ctx_t *prev;
+	event_t ev;
+	int8_t ret = true;
+#ifdef REPLAY_ON
+	uint8_t dispatching = ctx->dispatching;
+#endif
+
+	// timer task, power mode and all scheduler_*() calls of the tasks use this instance
+	prev = scheduler_running_ctx;
+	scheduler_running_ctx = ctx;
+	// events from other threads and signal handlers
+	events_ext_ctx_merge(&ctx->ext);
+	// events from other processes
+	events_shm_ctx_merge(ctx);
+	// timer events and cancels staged by ISRs
+	events_ctx_merge_staged_timer_events(&ctx->events);
+#ifdef REPLAY_ON
+	// inputs from the tasks are not recorded, they replay by themselves
+	ctx->dispatching = true;
+#endif
+	// get next event, due timer events first (dispatched straight from the timer events)
+	if((events_ctx_get_due_timer_event(&ctx->events, &ev) == true) ||
+	   (scheduler_get_next_event(ctx, &ev) == true)) {
+		// got a valid event, send it to the task(s)
+#ifdef EVENTS_LATENCY_ON
+		ctx->dispatch_stamp = ev.stamp;
+		ctx->dispatch_stamped = true;
+#endif
+		if(ev.tid == SCHEDULER_TID_DEFER) {
+			scheduler_exec_defer(ctx, (uint8_t)(uintptr_t)EVENT_DATA_UNPACK(ev.data));
+		}
+		else if(ev.tid == SCHEDULER_TID_PUBLISH) {
+			scheduler_exec_publish(ctx, ev.event, EVENT_DATA_UNPACK(ev.data));
+		}
+		else if(ev.flags & EV_FLAG_COALESCED) {
+			scheduler_exec_coalesced(ctx, &ev);
+		}
+		else {
+			scheduler_exec_task(ctx, ev.tid, ev.event, EVENT_DATA_UNPACK(ev.data));
+		}
+#ifdef EVENTS_LATENCY_ON
+		ctx->dispatch_stamped = false;
+#endif
+	}
+	else if(scheduler_run_idle_task(ctx) == false) {
+		// no events and no background work
+		ret = false;
+	}
+#ifdef REPLAY_ON
+	ctx->dispatching = dispatching;
+#endif
+	scheduler_running_ctx = prev;
+	return ret;
+}
+
+int8_t scheduler_ctx_run(scheduler_ctx_t *ctx) {
+	int8_t busy;
+	uint16_t flushed;
+
+	// this thread runs this instance from now on, power_mode_sleep() waits on its events
+	scheduler_running_ctx = ctx;
+	while(1) {
+		busy = scheduler_ctx_run_once(ctx);
+		flushed = 0;
+		if(ctx == scheduler_dlog_ctx) {
+			// format the log records, bounded per pass, also while idle tasks keep it busy
+			flushed = dlog_flush(busy ? 1 : DLOG_FLUSH_MAX);
+		}
+		if((busy == false) && (flushed == 0)) {
+			// no events, no background work and no log records, sleep
+			power_mode_sleep();
+		}
+	}
+	return false;
+}
+
+// - default instance ----------------------------------------------------------
+scheduler_ctx_t *scheduler_get_default_ctx(void) {
+	return &scheduler_default_ctx;
+}
+
+void scheduler_set_dlog_consumer(scheduler_ctx_t *ctx) {
+	scheduler_dlog_ctx = ctx;
+}
+
+scheduler_ctx_t *scheduler_get_ctx(void) {
+	if(scheduler_running_ctx != NULL) {
+		return scheduler_running_ctx;
+	}
+	return &scheduler_default_ctx;
+}
+
+void scheduler_init(void) {
+	scheduler_ctx_init(&scheduler_default_ctx);
+	// global, once: the other instances share the power modes
+	power_mode_init();
+}
+
+int8_t scheduler_add_task(task_t *p) {
+	return scheduler_ctx_add_task(scheduler_get_ctx(), p);
+}
+
+int8_t scheduler_remove_task(task_t *p) {
+	return scheduler_ctx_remove_task(scheduler_get_ctx(), p);
+}
+
+int8_t scheduler_start_task(uint8_t tid) {
+	return scheduler_ctx_start_task(scheduler_get_ctx(), tid);
+}
+
+int8_t scheduler_stop_task(uint8_t tid) {
+	return scheduler_ctx_stop_task(scheduler_get_ctx(), tid);
+}
+
+int8_t scheduler_add_idle_task(task_t *p) {
+	return scheduler_ctx_add_idle_task(scheduler_get_ctx(), p);
+}
+
+void scheduler_set_idle_budget(uint32_t budget_ns) {
+	scheduler_ctx_set_idle_budget(scheduler_get_ctx(), budget_ns);
+}
+
+int8_t scheduler_idle_should_yield(void) {
+	return scheduler_ctx_idle_should_yield(scheduler_get_ctx());
+}
+
+int8_t scheduler_set_task_budget(uint8_t tid, uint32_t budget_ns) {
+	return scheduler_ctx_set_task_budget(scheduler_get_ctx(), tid, budget_ns);
+}
+
+#ifdef EVENTS_LATENCY_ON
+uint32_t scheduler_get_task_latency(uint8_t tid, uint8_t which, uint16_t permille) {
+	return scheduler_ctx_get_task_latency(scheduler_get_ctx(), tid, which, permille);
+}
+
+int8_t scheduler_reset_task_latency(uint8_t tid) {
+	return scheduler_ctx_reset_task_latency(scheduler_get_ctx(), tid);
+}
+#endif
+
+int8_t scheduler_set_task_group(uint8_t tid, uint8_t group) {
+	return scheduler_ctx_set_task_group(scheduler_get_ctx(), tid, group);
+}
+
+int8_t scheduler_set_group_weight(uint8_t group, uint8_t weight) {
+	return scheduler_ctx_set_group_weight(scheduler_get_ctx(), group, weight);
+}
+
+void scheduler_set_overrun_hook(scheduler_overrun_hook_t hook) {
+	scheduler_ctx_set_overrun_hook(scheduler_get_ctx(), hook);
+}
+
+int8_t scheduler_should_yield(void) {
+	return scheduler_ctx_should_yield(scheduler_get_ctx());
+}
+
+uint8_t scheduler_get_current_tid(void) {
+	return scheduler_ctx_get_current_tid(scheduler_get_ctx());
+}
+
+int8_t scheduler_send_event(uint8_t tid, uint8_t event, void *data) {
+	return scheduler_ctx_send_event(scheduler_get_ctx(), tid, event, data);
+}
+
+int8_t scheduler_send_event_coalesced(uint8_t tid, uint8_t event, void *data) {
+	return scheduler_ctx_send_event_coalesced(scheduler_get_ctx(), tid, event, data);
+}
+
+int8_t scheduler_set_event_coalescing(uint8_t event, uint8_t on) {
+	return scheduler_ctx_set_event_coalescing(scheduler_get_ctx(), event, on);
+}
+
+uint16_t scheduler_get_event_count(void) {
+	return scheduler_ctx_get_event_count(scheduler_get_ctx());
+}
+
+int8_t scheduler_is_evvent_main_fifo_empty(void) {
+	return scheduler_ctx_is_event_main_fifo_empty(scheduler_get_ctx());
+}
+
+int8_t scheduler_subscribe(uint8_t tid, uint8_t event) {
+	return scheduler_ctx_subscribe(scheduler_get_ctx(), tid, event);
+}
+
+int8_t scheduler_unsubscribe(uint8_t tid, uint8_t event) {
+	return scheduler_ctx_unsubscribe(scheduler_get_ctx(), tid, event);
+}
+
+int8_t scheduler_publish(uint8_t event, void *data) {
+	return scheduler_ctx_publish(scheduler_get_ctx(), event, data);
+}
+
+int8_t scheduler_defer(scheduler_defer_func_t func, void *arg) {
+	return scheduler_ctx_defer(scheduler_get_ctx(), func, arg);
+}
+
+int8_t scheduler_defer_after(uint32_t timeout, scheduler_defer_func_t func, void *arg) {
+	return scheduler_ctx_defer_after(scheduler_get_ctx(), timeout, func, arg);
+}
+
+int8_t scheduler_start_event_timer(void) {
+	return scheduler_ctx_start_event_timer(scheduler_get_ctx());
+}
+
+int8_t scheduler_stop_event_timer(void) {
+	return scheduler_ctx_stop_event_timer(scheduler_get_ctx());
+}
+
+int8_t scheduler_add_timer_event(uint32_t timeout, uint8_t tid, uint8_t event, void *data) {
+	return scheduler_ctx_add_timer_event(scheduler_get_ctx(), timeout, tid, event, data);
+}
+
+int8_t scheduler_add_timer_event_at(uint64_t deadline, uint8_t tid, uint8_t event, void *data) {
+	return scheduler_ctx_add_timer_event_at(scheduler_get_ctx(), deadline, tid, event, data);
+}
+
+int8_t scheduler_add_timer_event_from_isr(uint32_t timeout, uint8_t tid, uint8_t event, void *data) {
+	return scheduler_ctx_add_timer_event_from_isr(scheduler_get_ctx(), timeout, tid, event, data);
+}
+
+uint16_t scheduler_cancel_timer_events(uint8_t tid, uint8_t event) {
+	return scheduler_ctx_cancel_timer_events(scheduler_get_ctx(), tid, event);
+}
+
+int8_t scheduler_cancel_timer_events_from_isr(uint8_t tid, uint8_t event) {
+	return scheduler_ctx_cancel_timer_events_from_isr(scheduler_get_ctx(), tid, event);
+}
+
+uint64_t scheduler_get_time_ticks(void) {
+	return scheduler_ctx_get_time_ticks(scheduler_get_ctx());
+}
+
+uint64_t scheduler_get_time_ns(void) {
+	return scheduler_ctx_get_time_ns(scheduler_get_ctx());
+}
+
+int8_t scheduler_run(void) {
+	return scheduler_ctx_run(&scheduler_default_ctx);
+}
@@ -12,32 +12,124 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "arch.h"
+#include "task.h"
 #include "events.h"
+#include "events_ext.h"
 #include "power_mode.h"
 
 /* - defines ---------------------------------------------------------------- */
 #define NB_OF_TASKS (16) /// number of tasks
+#define NB_OF_TOPICS (8) /// number of event codes tasks can subscribe to
+#define NB_OF_COALESCE_EVENTS (8) /// number of event codes that can be coalesced
+#define NB_OF_IDLE_TASKS (4) /// number of idle tasks (background jobs)
+#define NB_OF_DEFER_CALLS (16) /// number of pending deferred function calls
+#define NB_OF_BATCH_EVENTS (8) /// max. number of events per call of a batch handler (task_t.batch)
+#ifndef SCHEDULER_IDLE_BUDGET_NS
+#define SCHEDULER_IDLE_BUDGET_NS (1000000) /// default time budget of 1 idle slice
+#endif
+#ifndef SCHEDULER_TASK_BUDGET_NS
+#define SCHEDULER_TASK_BUDGET_NS (0) /// default runtime budget of a task per event, =0: no budget
+#endif
+
+// tid == 0 does not exist, it is used to publish an event to all subscribers
+#define SCHEDULER_TID_PUBLISH (0)
+// tid == 255 does not exist, it is used for deferred function calls
+#define SCHEDULER_TID_DEFER (255)
 
 /* - typedefs --------------------------------------------------------------- */
-typedef int8_t (*task_func_t) (uint8_t event, void *data);
+/**
+ * called after a task function exceeded its runtime budget
+ * @param	p			task that overran, it may get stopped here
+ * @param	event		that was executed
+ * @param	runtime_ns	of the task function
+ */
+typedef void (*scheduler_overrun_hook_t) (task_t *p, uint8_t event, uint32_t runtime_ns);
+
+/**
+ * deferred function call, see scheduler_defer()
+ * @param	arg		given to scheduler_defer()
+ */
+typedef void (*scheduler_defer_func_t) (void *arg);
+
+// - deferred function calls: pool, the event carries the index --------------
+typedef struct {
+	scheduler_defer_func_t func;	// =NULL: unused, free
+	void *arg;
+} scheduler_defer_t;
 
+// - topics: subscribers of an event code, 1 bit per position in task_list -----
+#if NB_OF_TASKS > 32
+#error "NB_OF_TASKS > 32, does not fit into topic_t.subscribers"
+#endif
 typedef struct {
-  task_func_t  task;
-  char *name;
-  uint8_t tid;    /// TID: task identifier
-  uint8_t state;  /// state of the task: none=0, started, running
-} task_t;
-// .tid
-
-// .state
-#define TASK_STATE_NONE (0)
-#define TASK_STATE_ACTIVE (1)
-#define TASK_STATE_RUNNING (2)
+	uint32_t subscribers;	// =0: unused, free
+	uint8_t event;
+} topic_t;
+
+// - coalescing: at most 1 pending (task, event) in main_fifo -----------------
+typedef struct {
+	uint8_t event;
+	uint8_t flags;
+} coalesce_t;
+
+/**
+ * 1 scheduler instance: its tasks, events, timer events and time base
+ * every instance is independent, e.g. 1 instance per thread (host port)
+ * do not access the members directly, use the scheduler_ctx_*() functions
+ */
+typedef struct scheduler_ctx_s {
+	task_t *task_list[NB_OF_TASKS];	// =NULL: unused, free
+	uint8_t task_count;
+	uint8_t tid_count; /// tid == 0 should not exist
+	uint8_t tid_pos[256];	// position in task_list by tid, =NB_OF_TASKS: no such task
+	uint8_t task_free[NB_OF_TASKS];	// stack of free positions in task_list
+	uint8_t task_free_count;
+	topic_t topic_list[NB_OF_TOPICS];
+	coalesce_t coalesce_list[NB_OF_COALESCE_EVENTS];
+	uint8_t coalesce_always_map[256/8];	// bit per event code, O(1) check in scheduler_send_event()
+	uint32_t coalesce_pending[NB_OF_COALESCE_EVENTS];	// bit per position in task_list
+	void *coalesce_data[NB_OF_COALESCE_EVENTS][NB_OF_TASKS];
+	uint16_t coalesce_count[NB_OF_COALESCE_EVENTS][NB_OF_TASKS];
+	uint16_t event_count;	// of the currently executed event
+	task_t *idle_list[NB_OF_IDLE_TASKS];	// =NULL: unused, free
+	uint8_t idle_next;	// round robin
+	uint8_t idle_added;	// bit per position in idle_list: added to task_list for its tid, removed when done
+	uint32_t idle_budget_ns;
+	task_t *current_task;	// =NULL: no task is running
+	uint64_t yield_deadline_ns;	// of the running task or idle slice
+	scheduler_overrun_hook_t overrun_hook;
+	scheduler_defer_t defer_list[NB_OF_DEFER_CALLS];
+	uint8_t defer_free[NB_OF_DEFER_CALLS];	// stack of free positions in defer_list
+	uint8_t defer_free_count;
+	uint8_t group_weight[EVENTS_NB_OF_GROUPS];	// events per turn of the group
+	uint8_t group_deficit[EVENTS_NB_OF_GROUPS];	// events left in the current turn
+	uint8_t group_next;	// group of the current turn
+#ifdef EVENTS_LATENCY_ON
+	uint32_t dispatch_stamp;	// stamp of the dispatched event
+	uint8_t dispatch_stamped;	// =true: dispatch_stamp is valid, the task calls count
+#endif
+	events_ctx_t events;
+#ifdef EVENTS_EXT_ON
+	events_ext_ctx_t ext;
+#endif
+#ifdef REPLAY_ON
+	void *replay_file;	// recording of the external inputs, =NULL: off, see replay_record_start()
+	uint8_t dispatching;	// =true: a task, deferred call or idle task runs, its inputs are not external
+#endif
+#ifdef EVENTS_SHM_ON
+	struct events_shm_s *shm;	// ring for other processes, =NULL: none, see events_shm_create()
+#endif
+#ifdef SNAPSHOT_ON
+	struct snapshot_s *snapshot;	// mapped snapshot file, =NULL: none, see snapshot_open()
+#endif
+} scheduler_ctx_t;
 
 // - public functions ----------------------------------------------------------
 
 /**
  * initialize the scheduler module
+ * the scheduler_*() functions use the scheduler instance that runs in the
+ * calling thread, or the default instance, see scheduler_get_ctx()
  */
 void scheduler_init(void);
 
@@ -75,12 +167,108 @@ int8_t scheduler_stop_task(uint8_t tid);
 
 /**
  * add the idle task, this task does not need to be started
+ * a task that was not added with scheduler_add_task() gets a tid here (and
+ * is removed again when its work is done), so it can get events too
+ * idle tasks run only if there are no events pending, they are called
+ * round robin with EV_IDLE to do 1 slice of background work, a slice should
+ * return as soon as scheduler_idle_should_yield() is true
+ * the task function returns 0 if its work is done (removed from idle tasks)
  * @param	p	pointer to task context
- * @return	status 	=true: OK, could add task to task_list
- *					=false: error, could not add task to task_list
+ * @return	status 	=true: OK, could add task to idle tasks
+ *					=false: error, could not add task to idle tasks
  */
 int8_t scheduler_add_idle_task(task_t *p);
 
+/**
+ * set the runtime budget of a task per event
+ * @param	tid			task identifier
+ * @param	budget_ns	time in ns, =0: SCHEDULER_TASK_BUDGET_NS
+ * @return	status 	=true: OK
+ *					=false: error, task does not exist
+ */
+int8_t scheduler_set_task_budget(uint8_t tid, uint32_t budget_ns);
+
+#ifdef EVENTS_LATENCY_ON
+/**
+ * get a percentile of the queueing delay or of the runtime of a task
+ * every event is stamped when it is queued (a timer event when it becomes
+ * due), every call of the task adds its queueing delay and its runtime to
+ * the log2 histograms of the task (task_t.queue_delay, task_t.exec_time)
+ * @param	tid			task identifier
+ * @param	which		SCHEDULER_LATENCY_QUEUE or SCHEDULER_LATENCY_EXEC
+ * @param	permille	percentile in 1/1000, e.g. 500: p50, 990: p99, 999: p999
+ * @return	upper bound of the bucket of the percentile in ns, =0: no samples or no such task
+ */
+uint32_t scheduler_get_task_latency(uint8_t tid, uint8_t which, uint16_t permille);
+// which
+#define SCHEDULER_LATENCY_QUEUE (0)
+#define SCHEDULER_LATENCY_EXEC (1)
+
+/**
+ * reset the latency histograms of a task
+ * @param	tid			task identifier
+ * @return	status 	=true: OK
+ *					=false: error, task does not exist
+ */
+int8_t scheduler_reset_task_latency(uint8_t tid);
+#endif // EVENTS_LATENCY_ON
+
+/**
+ * put a task into an event group, before it is started
+ * every group has its own fifo, the scheduler serves the groups by deficit
+ * round robin: each turn a group dispatches up to its weight in events, so a
+ * group that sends many events cannot starve the others, within a group the
+ * events stay in order, due timer events are dispatched first as always
+ * @param	tid		task identifier
+ * @param	group	event group, =0: main_fifo (default), < EVENTS_NB_OF_GROUPS
+ * @return	status 	=true: OK
+ *					=false: error, task does not exist, is started or no such group
+ */
+int8_t scheduler_set_task_group(uint8_t tid, uint8_t group);
+
+/**
+ * set the weight of an event group
+ * @param	group	event group, =0: main_fifo, < EVENTS_NB_OF_GROUPS
+ * @param	weight	events per turn of the group, >= 1, default: 1
+ * @return	status 	=true: OK
+ *					=false: error, no such group or weight = 0
+ */
+int8_t scheduler_set_group_weight(uint8_t group, uint8_t weight);
+
+/**
+ * set the hook that is called when a task exceeds its runtime budget
+ * @param	hook	function to call, =NULL: no hook
+ */
+void scheduler_set_overrun_hook(scheduler_overrun_hook_t hook);
+
+/**
+ * check if the currently running task used up its runtime budget
+ * a long task function should return and send itself a continuation event
+ * @return  =true: yield, budget is used up
+ *          =false: continue, budget left (or no budget)
+ */
+int8_t scheduler_should_yield(void);
+
+/**
+ * get the tid of the currently running task
+ * @return  tid, =0: no task is running
+ */
+uint8_t scheduler_get_current_tid(void);
+
+/**
+ * set the time budget of 1 idle slice
+ * @param	budget_ns	time in ns
+ */
+void scheduler_set_idle_budget(uint32_t budget_ns);
+
+/**
+ * check if the current idle slice should yield
+ * call from within an idle task
+ * @return  =true: yield, an event arrived or the budget is used up
+ *          =false: continue with background work
+ */
+int8_t scheduler_idle_should_yield(void);
+
 /**
  * send an event to a task given by its TID
  * @param	tid		task identifier
@@ -91,6 +279,84 @@ int8_t scheduler_add_idle_task(task_t *p);
  */
 int8_t scheduler_send_event(uint8_t tid, uint8_t event, void *data);
 
+/**
+ * send an event to a task, coalesce it with the same pending event
+ * if the same (tid, event) is still in the main_fifo, only its data is
+ * updated and its count is incremented, no additional main_fifo slot is used
+ * @param	tid		task identifier
+ * @param	event	event for the task to execute
+ * @param	data	additional data to task (if unused = NULL), the latest data is delivered
+ * @return	status 	=true: OK, could add or coalesce event
+ *					=false: error, could not add event to main_fifo
+ */
+int8_t scheduler_send_event_coalesced(uint8_t tid, uint8_t event, void *data);
+
+/**
+ * coalesce every scheduler_send_event() of this event code
+ * @param	event	event code
+ * @param	on		=true: always coalesce, =false: only scheduler_send_event_coalesced()
+ * @return	status 	=true: OK
+ *					=false: error, no more free coalescing event codes
+ */
+int8_t scheduler_set_event_coalescing(uint8_t event, uint8_t on);
+
+/**
+ * get the number of sends that were coalesced into the currently executed event
+ * call from within a task function
+ * @return  number of sends, =1: not coalesced
+ */
+uint16_t scheduler_get_event_count(void);
+
+/**
+ * call a function later from the scheduler, without a task
+ * the call is queued in the main_fifo like an event and dispatched in order
+ * @param	func	function to call
+ * @param	arg		argument to func (if unused = NULL)
+ * @return	status 	=true: OK, call is queued
+ *					=false: error, no more free deferred calls or main_fifo is full
+ */
+int8_t scheduler_defer(scheduler_defer_func_t func, void *arg);
+
+/**
+ * call a function from the scheduler after a timeout, without a task
+ * @param	timeout	after which to call, in ticks (EV_TIMER_TICK_HZ)
+ * @param	func	function to call
+ * @param	arg		argument to func (if unused = NULL)
+ * @return	status 	=true: OK, call is queued
+ *					=false: error, no more free deferred calls or timer events
+ */
+int8_t scheduler_defer_after(uint32_t timeout, scheduler_defer_func_t func, void *arg);
+
+/**
+ * subscribe a task to an event code (topic)
+ * every scheduler_publish() of this event is delivered to the task
+ * @param	tid		task identifier
+ * @param	event	event code to subscribe to
+ * @return	status 	=true: OK, task is subscribed
+ *					=false: error, no such task or no free topic
+ */
+int8_t scheduler_subscribe(uint8_t tid, uint8_t event);
+
+/**
+ * unsubscribe a task from an event code (topic)
+ * @param	tid		task identifier
+ * @param	event	event code to unsubscribe from
+ * @return	status 	=true: OK, task is not subscribed anymore
+ *					=false: error, task was not subscribed
+ */
+int8_t scheduler_unsubscribe(uint8_t tid, uint8_t event);
+
+/**
+ * publish an event to all tasks subscribed to it
+ * takes a single slot in the main_fifo, the scheduler delivers the event to
+ * every subscriber when it is dispatched
+ * @param	event	event to publish
+ * @param	data	additional data to the tasks (if unused = NULL)
+ * @return	status 	=true: OK, could add event to main_fifo (or no subscribers)
+ *					=false: error, could not add event to main_fifo
+ */
+int8_t scheduler_publish(uint8_t event, void *data);
+
 /**
  * start the event timer
  * @return	status 	=true: OK, could add event to main_fifo
@@ -107,14 +373,68 @@ int8_t scheduler_stop_event_timer(void);
 
 /**
  * send an event timer to a task given by its TID
- * @param timeout after which to send
+ * @param timeout after which to send, in ticks (EV_TIMER_TICK_HZ)
  * @param	tid		task identifier
  * @param	event	event for the task to execute
  * @param	data	additional data to task (if unused = NULL)
  * @return	status 	=true: OK, could add event to main_fifo
  *					=false: error, could not add event to main_fifo
  */
-int8_t scheduler_add_timer_event(uint16_t timeout, uint8_t tid, uint8_t event, void *data);
+int8_t scheduler_add_timer_event(uint32_t timeout, uint8_t tid, uint8_t event, void *data);
+
+/**
+ * send an event timer to a task given by its TID at an absolute deadline
+ * @param deadline at which to send, in ticks (see scheduler_get_time_ticks())
+ * @param	tid		task identifier
+ * @param	event	event for the task to execute
+ * @param	data	additional data to task (if unused = NULL)
+ * @return	status 	=true: OK, could add event to main_fifo
+ *					=false: error, could not add event to main_fifo
+ */
+int8_t scheduler_add_timer_event_at(uint64_t deadline, uint8_t tid, uint8_t event, void *data);
+
+/**
+ * send an event timer to a task given by its TID, call from an ISR
+ * lock-free, the timer event is staged and sorted in by the scheduler before
+ * it dispatches the next event, the timeout counts from then
+ * @param timeout after which to send, in ticks (EV_TIMER_TICK_HZ)
+ * @param	tid		task identifier
+ * @param	event	event for the task to execute
+ * @param	data	additional data to task (if unused = NULL)
+ * @return	status 	=true: OK, could stage the timer event
+ *					=false: error, timeout = 0 or too many staged timer events (EV_TIMER_STAGE_SIZE)
+ */
+int8_t scheduler_add_timer_event_from_isr(uint32_t timeout, uint8_t tid, uint8_t event, void *data);
+
+/**
+ * cancel the pending event timers of a task given by its TID
+ * @param	tid		task identifier
+ * @param	event	event to cancel, =EV_ANY: all event timers of the task
+ * @return	number of canceled event timers
+ */
+uint16_t scheduler_cancel_timer_events(uint8_t tid, uint8_t event);
+
+/**
+ * cancel the pending event timers of a task given by its TID, call from an ISR
+ * lock-free, staged like scheduler_add_timer_event_from_isr() and applied in the same order
+ * @param	tid		task identifier
+ * @param	event	event to cancel, =EV_ANY: all event timers of the task
+ * @return	status 	=true: OK, could stage the cancel
+ *					=false: error, too many staged timer events (EV_TIMER_STAGE_SIZE)
+ */
+int8_t scheduler_cancel_timer_events_from_isr(uint8_t tid, uint8_t event);
+
+/**
+ * get the current time of the scheduler (64 bit, monotonic)
+ * @return  time in ticks
+ */
+uint64_t scheduler_get_time_ticks(void);
+
+/**
+ * get the current time of the scheduler (64 bit, monotonic)
+ * @return  time in ns
+ */
+uint64_t scheduler_get_time_ns(void);
 
 /**
  * check if event main_fifo is empty
@@ -129,4 +449,92 @@ int8_t scheduler_is_event_main_fifo_empty(void);
  */
 int8_t scheduler_run(void);
 
+// - scheduler instances -------------------------------------------------------
+
+/**
+ * get the default scheduler instance, used by scheduler_init(), scheduler_run()
+ * @return  pointer to the default instance
+ */
+scheduler_ctx_t *scheduler_get_default_ctx(void);
+
+/**
+ * get the scheduler instance that runs in the calling thread
+ * (inside scheduler_ctx_run()/scheduler_ctx_run_once()), else the default instance
+ * @return  pointer to the instance
+ */
+scheduler_ctx_t *scheduler_get_ctx(void);
+
+/**
+ * select the instance whose scheduler_ctx_run() formats the dlog records,
+ * dlog_flush() has a single consumer, set it before the instances run
+ * @param   ctx     scheduler instance, =NULL: none, the application reads
+ *                  the records itself (dlog_read()), default: the default instance
+ */
+void scheduler_set_dlog_consumer(scheduler_ctx_t *ctx);
+
+/**
+ * the timer event of a deferred call was cancelled or purged before it was due,
+ * free the deferred call, called by the events
+ * @param   ctx     scheduler instance
+ * @param   n       position in defer_list, from the event data
+ */
+void scheduler_ctx_cancel_defer(scheduler_ctx_t *ctx, uint8_t n);
+
+/**
+ * process 1 event (or 1 idle slice) of a scheduler instance, does not sleep
+ * drive several instances from 1 loop or step an instance in a test
+ * @param	ctx		scheduler instance
+ * @return	=true: processed an event or an idle slice
+ *			=false: nothing to do
+ */
+int8_t scheduler_ctx_run_once(scheduler_ctx_t *ctx);
+
+/**
+ * release what an instance holds outside of its memory: the doorbell of the
+ * external events, the shared memory ring, an open snapshot or recording
+ * call it before the instance is freed or initialized again
+ * @param	ctx		scheduler instance
+ */
+void scheduler_ctx_destroy(scheduler_ctx_t *ctx);
+
+// same as the functions above, on a given scheduler instance
+void scheduler_ctx_init(scheduler_ctx_t *ctx);
+int8_t scheduler_ctx_add_task(scheduler_ctx_t *ctx, task_t *p);
+int8_t scheduler_ctx_remove_task(scheduler_ctx_t *ctx, task_t *p);
+int8_t scheduler_ctx_start_task(scheduler_ctx_t *ctx, uint8_t tid);
+int8_t scheduler_ctx_stop_task(scheduler_ctx_t *ctx, uint8_t tid);
+int8_t scheduler_ctx_add_idle_task(scheduler_ctx_t *ctx, task_t *p);
+int8_t scheduler_ctx_set_task_budget(scheduler_ctx_t *ctx, uint8_t tid, uint32_t budget_ns);
+#ifdef EVENTS_LATENCY_ON
+uint32_t scheduler_ctx_get_task_latency(scheduler_ctx_t *ctx, uint8_t tid, uint8_t which, uint16_t permille);
+int8_t scheduler_ctx_reset_task_latency(scheduler_ctx_t *ctx, uint8_t tid);
+#endif
+int8_t scheduler_ctx_set_task_group(scheduler_ctx_t *ctx, uint8_t tid, uint8_t group);
+int8_t scheduler_ctx_set_group_weight(scheduler_ctx_t *ctx, uint8_t group, uint8_t weight);
+void scheduler_ctx_set_overrun_hook(scheduler_ctx_t *ctx, scheduler_overrun_hook_t hook);
+int8_t scheduler_ctx_should_yield(scheduler_ctx_t *ctx);
+uint8_t scheduler_ctx_get_current_tid(scheduler_ctx_t *ctx);
+void scheduler_ctx_set_idle_budget(scheduler_ctx_t *ctx, uint32_t budget_ns);
+int8_t scheduler_ctx_idle_should_yield(scheduler_ctx_t *ctx);
+int8_t scheduler_ctx_send_event(scheduler_ctx_t *ctx, uint8_t tid, uint8_t event, void *data);
+int8_t scheduler_ctx_send_event_coalesced(scheduler_ctx_t *ctx, uint8_t tid, uint8_t event, void *data);
+int8_t scheduler_ctx_set_event_coalescing(scheduler_ctx_t *ctx, uint8_t event, uint8_t on);
+uint16_t scheduler_ctx_get_event_count(scheduler_ctx_t *ctx);
+int8_t scheduler_ctx_subscribe(scheduler_ctx_t *ctx, uint8_t tid, uint8_t event);
+int8_t scheduler_ctx_unsubscribe(scheduler_ctx_t *ctx, uint8_t tid, uint8_t event);
+int8_t scheduler_ctx_publish(scheduler_ctx_t *ctx, uint8_t event, void *data);
+int8_t scheduler_ctx_defer(scheduler_ctx_t *ctx, scheduler_defer_func_t func, void *arg);
+int8_t scheduler_ctx_defer_after(scheduler_ctx_t *ctx, uint32_t timeout, scheduler_defer_func_t func, void *arg);
+int8_t scheduler_ctx_start_event_timer(scheduler_ctx_t *ctx);
+int8_t scheduler_ctx_stop_event_timer(scheduler_ctx_t *ctx);
+int8_t scheduler_ctx_add_timer_event(scheduler_ctx_t *ctx, uint32_t timeout, uint8_t tid, uint8_t event, void *data);
+int8_t scheduler_ctx_add_timer_event_at(scheduler_ctx_t *ctx, uint64_t deadline, uint8_t tid, uint8_t event, void *data);
+int8_t scheduler_ctx_add_timer_event_from_isr(scheduler_ctx_t *ctx, uint32_t timeout, uint8_t tid, uint8_t event, void *data);
+uint16_t scheduler_ctx_cancel_timer_events(scheduler_ctx_t *ctx, uint8_t tid, uint8_t event);
+int8_t scheduler_ctx_cancel_timer_events_from_isr(scheduler_ctx_t *ctx, uint8_t tid, uint8_t event);
+uint64_t scheduler_ctx_get_time_ticks(scheduler_ctx_t *ctx);
+uint64_t scheduler_ctx_get_time_ns(scheduler_ctx_t *ctx);
+int8_t scheduler_ctx_is_event_main_fifo_empty(scheduler_ctx_t *ctx);
+int8_t scheduler_ctx_run(scheduler_ctx_t *ctx);
+
 #endif // _MM_SCHEDULER_H_
@@ -0,0 +1,272 @@
+/**
+ * Martin Egli
+ * 2024-10-17
+ * snapshot of the scheduler state in a memory mapped file (host port)
+ * coop scheduler for mcu
+ */
+
+// - includes ------------------------------------------------------------------
+#include "snapshot.h"
+
+#ifdef SNAPSHOT_ON
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "dlog.h"
+
+// - private functions ---------------------------------------------------------
+static uint64_t snapshot_realtime_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * get the latest data of a pending coalesced event
+ * @param   ev  coalesced event from a fifo
+ */
+static void *snapshot_coalesced_data(scheduler_ctx_t *ctx, event_t *ev) {
+    uint8_t pos, idx;
+    if((pos = ctx->tid_pos[ev->tid]) >= NB_OF_TASKS) {
+        return NULL;
+    }
+    for(idx = 0; idx < NB_OF_COALESCE_EVENTS; idx++) {
+        if((ctx->coalesce_list[idx].event == ev->event) &&
+           (ctx->coalesce_pending[idx] & ((uint32_t)1 << pos))) {
+            return ctx->coalesce_data[idx][pos];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * save the events of 1 fifo, at (rd, wr], in dispatch order
+ * @return  number of events in s->event
+ */
+static uint16_t snapshot_save_fifo(scheduler_ctx_t *ctx, snapshot_t *s, uint16_t cnt, fifo_t *f, event_t *data) {
+    snapshot_event_t *se;
+    event_t *ev;
+    uint16_t n;
+    void *d;
+
+    for(n = f->rd; n != f->wr; ) {
+        n = fifo_next_pos(n, f->size);
+        ev = &data[n];
+        if((ev->tid == SCHEDULER_TID_DEFER) || (ev->event >= EV_START) ||
+           (ev->tid == ctx->events.timer_proc.tid) || (cnt >= SNAPSHOT_NB_OF_EVENTS)) {
+            // deferred calls (function pointers) and scheduler internal events are not saved
+            continue;
+        }
+        if(ev->flags & EV_FLAG_COALESCED) {
+            d = snapshot_coalesced_data(ctx, ev);
+        }
+        else {
+            d = EVENT_DATA_UNPACK(ev->data);
+        }
+        se = &s->event[cnt++];
+        se->data = (uint64_t)(uintptr_t)d;
+        se->tid = ev->tid;
+        se->event = ev->event;
+        se->flags = ev->flags & EV_FLAG_COALESCED;
+    }
+    return cnt;
+}
+
+/**
+ * find the tid of a task by its name
+ * @return  tid, =0: no such task
+ */
+static uint8_t snapshot_find_tid(scheduler_ctx_t *ctx, const char *name) {
+    uint8_t n;
+    for(n = 0; n < NB_OF_TASKS; n++) {
+        if((ctx->task_list[n] != NULL) && (ctx->task_list[n]->name != NULL) &&
+           (strncmp(ctx->task_list[n]->name, name, SNAPSHOT_NAME_LEN) == 0)) {
+            return ctx->task_list[n]->tid;
+        }
+    }
+    return 0;
+}
+
+// - public functions ----------------------------------------------------------
+int8_t snapshot_ctx_open(scheduler_ctx_t *ctx, const char *path) {
+    void *p;
+    int fd;
+
+    if((ctx == NULL) || (path == NULL) || (ctx->snapshot != NULL)) {
+        return false;
+    }
+    if((fd = open(path, O_RDWR | O_CREAT, 0600)) < 0) {
+        return false;
+    }
+    // a new file is filled with 0: no valid snapshot
+    if(ftruncate(fd, sizeof(snapshot_t)) != 0) {
+        close(fd);
+        return false;
+    }
+    p = mmap(NULL, sizeof(snapshot_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    // the mapping stays valid without the file descriptor
+    close(fd);
+    if(p == MAP_FAILED) {
+        return false;
+    }
+    ctx->snapshot = p;
+    return true;
+}
+
+int8_t snapshot_ctx_save(scheduler_ctx_t *ctx) {
+    events_ctx_t *e;
+    snapshot_t *s;
+    snapshot_timer_t *st;
+    uint64_t now;
+    uint16_t sr, n, cnt;
+    uint8_t g, t;
+
+    if((ctx == NULL) || ((s = ctx->snapshot) == NULL)) {
+        return false;
+    }
+    e = &ctx->events;
+    // invalid until completely written, a crash in between leaves no torn snapshot
+    s->header.valid = 0;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    lock_interrupt(sr);
+    for(n = 0, t = 0; n < NB_OF_TASKS; n++) {
+        if((ctx->task_list[n] == NULL) || (ctx->task_list[n]->name == NULL) ||
+           (ctx->task_list[n] == &e->timer_proc)) {
+            continue;
+        }
+        strncpy(s->task[t].name, ctx->task_list[n]->name, SNAPSHOT_NAME_LEN - 1);
+        s->task[t].name[SNAPSHOT_NAME_LEN - 1] = 0;
+        s->task[t].tid = ctx->task_list[n]->tid;
+        s->task[t].state = (ctx->task_list[n]->state != TASK_STATE_NONE) ? TASK_STATE_ACTIVE : TASK_STATE_NONE;
+        t++;
+    }
+    cnt = snapshot_save_fifo(ctx, s, 0, &e->main_fifo, e->main_fifo_data);
+    for(g = 1; g < EVENTS_NB_OF_GROUPS; g++) {
+        cnt = snapshot_save_fifo(ctx, s, cnt, &e->group_fifo[g - 1], e->group_fifo_data[g - 1]);
+    }
+    s->header.nb_tasks = t;
+    s->header.nb_events = cnt;
+
+    // timer events: the time left, the clock of the next process starts anew
+    now = events_ctx_get_time_ticks(e);
+    cnt = 0;
+    for(n = e->timer_fifo.rd; n != e->timer_fifo.wr; ) {
+        n = fifo_next_pos(n, e->timer_fifo.size);
+        if(((e->timer_ctrl[n] & EV_TIMER_CTRL_ACTIVE) == 0) ||
+           (e->timer_event[n].tid == SCHEDULER_TID_DEFER)) {
+            continue;
+        }
+        st = &s->timer[cnt++];
+        st->remaining = (e->timer_compare[n] > now) ? (e->timer_compare[n] - now) : 0;
+        st->data = (uint64_t)(uintptr_t)EVENT_DATA_UNPACK(e->timer_event[n].data);
+        st->tid = e->timer_event[n].tid;
+        st->event = e->timer_event[n].event;
+    }
+    restore_interrupt(sr);
+    s->header.nb_timers = cnt;
+    s->header.magic = SNAPSHOT_MAGIC;
+    s->header.version = SNAPSHOT_VERSION;
+    s->header.size = sizeof(snapshot_t);
+    s->header.tick_hz = EV_TIMER_TICK_HZ;
+    s->header.saved_ns = snapshot_realtime_ns();
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    s->header.valid = 1;
+    // written back by the kernel, also if this process crashes
+    msync(s, sizeof(snapshot_t), MS_ASYNC);
+    return true;
+}
+
+uint16_t snapshot_ctx_restore(scheduler_ctx_t *ctx) {
+    uint8_t tid_map[256];
+    snapshot_t *s;
+    snapshot_event_t *se;
+    snapshot_timer_t *st;
+    uint64_t now, elapsed, saved_ns;
+    uint16_t n, cnt = 0;
+    uint8_t tid;
+
+    if((ctx == NULL) || ((s = ctx->snapshot) == NULL)) {
+        return 0;
+    }
+    if((s->header.magic != SNAPSHOT_MAGIC) || (s->header.version != SNAPSHOT_VERSION) ||
+       (s->header.valid == 0) || (s->header.size != sizeof(snapshot_t)) ||
+       (s->header.tick_hz != EV_TIMER_TICK_HZ)) {
+        // no snapshot, a torn one or from another build
+        return 0;
+    }
+    // the tids of this process, by task name, =0: unknown task, dropped
+    memset(tid_map, 0, sizeof(tid_map));
+    for(n = 0; (n < s->header.nb_tasks) && (n < NB_OF_TASKS); n++) {
+        s->task[n].name[SNAPSHOT_NAME_LEN - 1] = 0;
+        if((tid = snapshot_find_tid(ctx, s->task[n].name)) == 0) {
+            DLOG_WARN("snapshot: task %llu unknown, dropped\n", s->task[n].tid);
+            continue;
+        }
+        tid_map[s->task[n].tid] = tid;
+        if((s->task[n].state != TASK_STATE_NONE) &&
+           (ctx->task_list[ctx->tid_pos[tid]]->state == TASK_STATE_NONE)) {
+            scheduler_ctx_start_task(ctx, tid);
+        }
+    }
+    for(n = 0; (n < s->header.nb_events) && (n < SNAPSHOT_NB_OF_EVENTS); n++) {
+        se = &s->event[n];
+        if(se->tid == SCHEDULER_TID_PUBLISH) {
+            cnt += (scheduler_ctx_publish(ctx, se->event, (void *)(uintptr_t)se->data) == true);
+        }
+        else if((tid = tid_map[se->tid]) != 0) {
+            if(se->flags & EV_FLAG_COALESCED) {
+                cnt += (scheduler_ctx_send_event_coalesced(ctx, tid, se->event, (void *)(uintptr_t)se->data) == true);
+            }
+            else {
+                cnt += (scheduler_ctx_send_event(ctx, tid, se->event, (void *)(uintptr_t)se->data) == true);
+            }
+        }
+    }
+    // rebase the timer events onto the clock of this process, less the time it was down
+    now = events_ctx_get_time_ticks(&ctx->events);
+    saved_ns = s->header.saved_ns;
+    elapsed = snapshot_realtime_ns();
+    elapsed = (elapsed > saved_ns) ? events_ns_to_ticks(elapsed - saved_ns) : 0;
+    for(n = 0; (n < s->header.nb_timers) && (n < EV_TIMER_NB_EVENTS); n++) {
+        st = &s->timer[n];
+        if((tid = tid_map[st->tid]) == 0) {
+            continue;
+        }
+        cnt += (scheduler_ctx_add_timer_event_at(ctx, now + ((st->remaining > elapsed) ? (st->remaining - elapsed) : 0),
+            tid, st->event, (void *)(uintptr_t)st->data) == true);
+    }
+    // restored once, the next snapshot_save() writes a new one
+    s->header.valid = 0;
+    return cnt;
+}
+
+void snapshot_ctx_close(scheduler_ctx_t *ctx) {
+    if((ctx == NULL) || (ctx->snapshot == NULL)) {
+        return;
+    }
+    msync(ctx->snapshot, sizeof(snapshot_t), MS_SYNC);
+    munmap(ctx->snapshot, sizeof(snapshot_t));
+    ctx->snapshot = NULL;
+}
+
+// - default instance ----------------------------------------------------------
+int8_t snapshot_open(const char *path) {
+    return snapshot_ctx_open(scheduler_get_ctx(), path);
+}
+
+int8_t snapshot_save(void) {
+    return snapshot_ctx_save(scheduler_get_ctx());
+}
+
+uint16_t snapshot_restore(void) {
+    return snapshot_ctx_restore(scheduler_get_ctx());
+}
+
+void snapshot_close(void) {
+    snapshot_ctx_close(scheduler_get_ctx());
+}
+
+#endif // SNAPSHOT_ON
@@ -0,0 +1,116 @@
+/**
+ * Martin Egli
+ * 2024-10-17
+ * snapshot of the scheduler state in a memory mapped file (host port)
+ * the queued events, the pending timer events and the task states are saved
+ * to a file region with a versioned header, after a restart the new process
+ * restores them, timer events are rebased onto the new clock
+ * define SNAPSHOT_ON to use it
+ * coop scheduler for mcu
+ */
+
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+//- includes -------------------------------------------------------------------
+#include <stdint.h>
+#include <stdbool.h>
+#include "scheduler.h"
+
+//- defines --------------------------------------------------------------------
+#define SNAPSHOT_MAGIC (0x53534D4Du)    /// "MMSS"
+#define SNAPSHOT_VERSION (1)
+#define SNAPSHOT_NAME_LEN (16)          /// tasks are matched by name, the tids can change
+#define SNAPSHOT_NB_OF_EVENTS (EVENTS_MAIN_FIFO_SIZE + (EVENTS_NB_OF_GROUPS - 1) * EVENTS_GROUP_FIFO_SIZE)
+
+#ifdef SNAPSHOT_ON
+
+//- typedefs -------------------------------------------------------------------
+/**
+ * the mapped file region, all fields have fixed sizes, no pointers
+ * event data is saved as is: only values and indices survive a restart, no pointers
+ */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t valid;         /// =0 while saving, a torn snapshot is not restored
+    uint32_t size;          /// sizeof(snapshot_t) of the writer
+    uint32_t tick_hz;       /// EV_TIMER_TICK_HZ of the writer
+    uint64_t saved_ns;      /// CLOCK_REALTIME at save, to rebase the timer events
+    uint16_t nb_tasks;
+    uint16_t nb_events;
+    uint16_t nb_timers;
+} snapshot_header_t;
+
+typedef struct {
+    char name[SNAPSHOT_NAME_LEN];
+    uint8_t tid;
+    uint8_t state;
+} snapshot_task_t;
+
+typedef struct {
+    uint64_t data;
+    uint8_t tid;            /// receiving task, SCHEDULER_TID_PUBLISH: published event
+    uint8_t event;
+    uint8_t flags;          /// EV_FLAG_COALESCED: sent again with scheduler_send_event_coalesced()
+} snapshot_event_t;
+
+typedef struct {
+    uint64_t remaining;     /// ticks until the timer event is due, =0: due
+    uint64_t data;
+    uint8_t tid;
+    uint8_t event;
+} snapshot_timer_t;
+
+typedef struct snapshot_s {
+    snapshot_header_t header;
+    snapshot_task_t task[NB_OF_TASKS];
+    snapshot_event_t event[SNAPSHOT_NB_OF_EVENTS];  /// in dispatch order per group
+    snapshot_timer_t timer[EV_TIMER_NB_EVENTS];     /// in deadline order
+} snapshot_t;
+
+// - public functions ----------------------------------------------------------
+// the snapshot_*() functions use the scheduler instance that runs in the
+// calling thread, or the default instance, see scheduler_get_ctx()
+
+/**
+ * map the snapshot file, create it if it does not exist
+ * an existing snapshot is kept until snapshot_save(), see snapshot_restore()
+ * @param   path    of the snapshot file
+ * @return  =true: OK, =false: error, could not open or map the file
+ */
+int8_t snapshot_open(const char *path);
+
+/**
+ * save the queued events, the pending timer events and the task states
+ * call from the scheduler (e.g. a task or a deferred call), before a planned
+ * restart or periodically, the mapping survives a crash of the process
+ * deferred calls (function pointers) and coalescing counts are not saved
+ * @return  =true: OK, =false: error, no snapshot file
+ */
+int8_t snapshot_save(void);
+
+/**
+ * restore a valid snapshot, after all tasks are added (matched by name)
+ * starts the tasks that were started, queues the events again and adds the
+ * timer events, less the time the process was down (due ones right away)
+ * events and timer events of unknown tasks are dropped
+ * a snapshot is restored once, it is invalid afterwards
+ * @return  number of restored events and timer events, =0: nothing to restore
+ */
+uint16_t snapshot_restore(void);
+
+/**
+ * unmap the snapshot file
+ */
+void snapshot_close(void);
+
+// - scheduler instances -------------------------------------------------------
+int8_t snapshot_ctx_open(scheduler_ctx_t *ctx, const char *path);
+int8_t snapshot_ctx_save(scheduler_ctx_t *ctx);
+uint16_t snapshot_ctx_restore(scheduler_ctx_t *ctx);
+void snapshot_ctx_close(scheduler_ctx_t *ctx);
+
+#endif // SNAPSHOT_ON
+
+#endif // _SNAPSHOT_H_
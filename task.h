@@ -0,0 +1,64 @@
+/**
+ * Martin Egli
+ * 2024-10-13
+ * task context, used by the scheduler and the events
+ * coop scheduler for mcu
+ */
+
+#ifndef _MM_TASK_H_
+#define _MM_TASK_H_
+
+/* - includes --------------------------------------------------------------- */
+#include <stdint.h>
+
+/* - defines ---------------------------------------------------------------- */
+#define TASK_HISTOGRAM_NB_OF_BUCKETS (32) /// bucket n: [2^n, 2^(n+1)) ns, bucket 0: [0, 2) ns
+
+/* - typedefs --------------------------------------------------------------- */
+typedef int8_t (*task_func_t) (uint8_t event, void *data);
+
+/**
+ * log2 histogram of times in ns, see scheduler_get_task_latency()
+ */
+typedef struct {
+  uint32_t bucket[TASK_HISTOGRAM_NB_OF_BUCKETS];
+  uint32_t count;
+} task_histogram_t;
+
+struct event_s;
+/**
+ * optional batch handler of a task, gets all pending events of the task at once
+ * (at most NB_OF_BATCH_EVENTS), the data of an event is EVENT_DATA_UNPACK(ev[n].data)
+ * @param	ev		array of events, in the order they were sent
+ * @param	count	number of events, >= 1
+ * @return	=0: stop the task, else: the task remains active
+ */
+typedef int8_t (*task_batch_func_t) (struct event_s *ev, uint16_t count);
+
+typedef struct {
+  task_func_t  task;
+  char *name;
+  uint8_t tid;    /// TID: task identifier
+  uint8_t state;  /// state of the task: none=0, started, running
+  uint32_t budget_ns;       /// runtime budget per event, =0: SCHEDULER_TASK_BUDGET_NS
+  uint32_t runtime_max_ns;  /// longest runtime of the task function
+  uint16_t overruns;        /// number of times the budget was exceeded
+  uint8_t overrun_event;    /// event of the last overrun
+  task_batch_func_t batch;  /// =NULL: 1 event per call of task, else: events are delivered to batch
+                            /// (task is still needed, for EV_STOP, published events and a coalesced event
+                            /// that is dispatched first, coalesced events behind it go to batch with
+                            /// their latest data, scheduler_get_event_count() does not apply there)
+  uint8_t group;            /// event group, =0: main_fifo, see scheduler_set_task_group()
+#ifdef EVENTS_LATENCY_ON
+  task_histogram_t queue_delay;   /// from queueing (or becoming due) to the call of the task
+  task_histogram_t exec_time;     /// runtime of the task function
+#endif
+} task_t;
+// .tid
+
+// .state
+#define TASK_STATE_NONE (0)
+#define TASK_STATE_ACTIVE (1)
+#define TASK_STATE_RUNNING (2)
+
+#endif // _MM_TASK_H_
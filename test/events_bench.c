@@ -0,0 +1,93 @@
+/**
+ * Martin Egli
+ * 2024-10-14
+ * scheduler https://github.com/mwuerms/mmschedule
+ * throughput of the event main_fifo and the timer events, default vs. compact layout
+ * + compile from main folder, default layout:
+ *   gcc -O2 scheduler.c events.c events_ext.c power_mode.c fifo.c dlog.c channel.c test/events_bench.c -o test/events_bench
+ * + compact layout:
+ *   gcc -O2 -DEVENTS_COMPACT scheduler.c events.c events_ext.c power_mode.c fifo.c dlog.c channel.c test/events_bench.c -o test/events_bench_compact
+ * + run from main folder: ./test/events_bench; ./test/events_bench_compact
+ * + many timer events, SIMD vs. scalar compare scan: add -mavx2 -DEV_TIMER_NB_EVENTS=4096,
+ *   and -DEV_TIMER_SCAN_SCALAR for the scalar version
+ */
+#include <stdio.h>
+#include <time.h>
+
+// code under test
+#include "../scheduler.h"
+
+#define BENCH_ROUNDS (200000)
+#define BENCH_BURST (EVENTS_MAIN_FIFO_SIZE - 1)
+// about the same number of timer events for every EV_TIMER_NB_EVENTS
+#define BENCH_TIMER_ROUNDS ((BENCH_ROUNDS / 10) * 31 / (EV_TIMER_NB_EVENTS - 1) + 1)
+
+static scheduler_ctx_t bench_ctx;
+
+static uint64_t bench_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * fill the main_fifo with a burst of events and read them back
+ * @return  ns per event (add + get)
+ */
+static double bench_main_fifo(void) {
+    events_ctx_t *e = &bench_ctx.events;
+    event_t ev = {.tid = 2, .event = 1, .flags = 0};
+    uint32_t n, k;
+    uint64_t start;
+
+    start = bench_time_ns();
+    for(n = 0; n < BENCH_ROUNDS; n++) {
+        for(k = 0; k < BENCH_BURST; k++) {
+            ev.data = EVENT_DATA_PACK((void *)(uintptr_t)k);
+            events_ctx_add_to_main_fifo(e, &ev);
+        }
+        for(k = 0; k < BENCH_BURST; k++) {
+            events_ctx_get_from_main_fifo(e, &ev);
+        }
+    }
+    return (double)(bench_time_ns() - start) / ((double)BENCH_ROUNDS * BENCH_BURST);
+}
+
+/**
+ * add timer events at pseudo random deadlines (sorted insert) and purge them
+ * @return  ns per timer event (add + purge)
+ */
+static double bench_timer_events(void) {
+    events_ctx_t *e = &bench_ctx.events;
+    event_t ev = {.tid = 2, .event = 1, .flags = 0};
+    uint32_t n, k, rnd = 1;
+    uint64_t start;
+
+    start = bench_time_ns();
+    for(n = 0; n < BENCH_TIMER_ROUNDS; n++) {
+        for(k = 0; k < EV_TIMER_NB_EVENTS - 1; k++) {
+            rnd = rnd * 1103515245u + 12345u;
+            events_ctx_add_single_timer_event_at(e, 1000 + (rnd >> 8), &ev);
+        }
+        events_ctx_purge_timer_events(e, ev.tid);
+    }
+    return (double)(bench_time_ns() - start) / ((double)BENCH_TIMER_ROUNDS * (EV_TIMER_NB_EVENTS - 1));
+}
+
+int main(void) {
+    scheduler_ctx_init(&bench_ctx);
+#ifdef EVENTS_COMPACT
+    printf("layout: compact (EVENTS_COMPACT)\n");
+#else
+    printf("layout: default\n");
+#endif
+    printf(" sizeof(event_t):   %d bytes\n", (int)sizeof(event_t));
+    printf(" main_fifo data:    %d bytes (%d events)\n",
+        (int)sizeof(bench_ctx.events.main_fifo_data), EVENTS_MAIN_FIFO_SIZE);
+    printf(" timer events data: %d bytes (%d timer events)\n",
+        (int)(sizeof(bench_ctx.events.timer_compare) + sizeof(bench_ctx.events.timer_event) + sizeof(bench_ctx.events.timer_ctrl)),
+        EV_TIMER_NB_EVENTS);
+    printf(" main_fifo:    %6.2f ns/event (add + get)\n", bench_main_fifo());
+    printf(" timer events: %6.2f ns/event (sorted add + purge)\n", bench_timer_events());
+    return 0;
+}
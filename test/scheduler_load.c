@@ -0,0 +1,543 @@
+/**
+ * Martin Egli
+ * 2024-10-20
+ * scheduler https://github.com/mwuerms/mmschedule
+ * load generator and soak harness: drives a scheduler instance with a tunable
+ * mix of events and timer events for seconds to hours and reports throughput,
+ * drops, queue high-water marks and latency percentiles, to find where a
+ * configuration saturates
+ * + compile from main folder:
+ *   gcc -O2 scheduler.c events.c events_ext.c power_mode.c fifo.c dlog.c channel.c test/scheduler_load.c -o test/scheduler_load -lm
+ * + other configurations: add -DEVENTS_COMPACT, -DEVENTS_MAIN_FIFO_SIZE=..., -DEV_TIMER_NB_EVENTS=...,
+ *   -DEVENTS_LATENCY_ON (also prints the queueing delay and runtime of the tasks, add
+ *   -DEV_TIMER_HOST_CLOCK for ns instead of tick resolution)
+ * + run from main folder: ./test/scheduler_load -h
+ *   e.g. soak for 10 minutes: ./test/scheduler_load -t 8 -r 200000 -a bursty -b 16 -m 20 -f 2 -d 600 -i 10
+ *   e.g. find the saturation: ./test/scheduler_load -t 4 -r 50000 -w 2000 -s 8
+ *
+ * single thread: the generator emits all arrivals that are due between 2
+ * dispatches, an arrival keeps its planned time, so a scheduler that falls
+ * behind shows up in the latency instead of slowing down the generator
+ * latency: from the planned time of an arrival (events) or the deadline
+ * (timer events, 1 tick resolution) to the start of the task function
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+// code under test
+#include "../scheduler.h"
+
+#define LOAD_NB_OF_TASKS_MAX (NB_OF_TASKS - 1)  // 1 task is the timer task
+#define LOAD_NB_OF_SAMPLES (65536)              // latency samples kept per run, reservoir sampling
+
+// events of the load tasks
+#define LOAD_EV_ARRIVAL (1)
+#define LOAD_EV_FANOUT (2)
+#define LOAD_EV_TIMER (3)
+
+// arrival distributions
+#define LOAD_ARRIVAL_POISSON (0)
+#define LOAD_ARRIVAL_BURSTY (1)
+#define LOAD_ARRIVAL_UNIFORM (2)
+
+// the planned time travels in the event data, 32 bit with EVENTS_COMPACT: us resolution
+#ifdef EVENTS_COMPACT
+#define LOAD_TIME_SHIFT (10)
+#define LOAD_TIME_MASK (0xFFFFFFFFull)
+#else
+#define LOAD_TIME_SHIFT (0)
+#define LOAD_TIME_MASK (~0ull)
+#endif
+
+typedef struct {
+    uint8_t nb_of_tasks;
+    uint8_t arrival;
+    uint8_t fanout;         // number of tasks an arrival is forwarded to
+    uint8_t publish;        // =true: arrivals are published to all tasks
+    uint8_t timer_percent;  // share of arrivals that arm a timer event
+    uint32_t timeout_max;   // timer events: 1 ... timeout_max ticks
+    uint32_t burst;         // events per burst
+    uint32_t work_ns;       // busy time per event in the tasks
+    double rate;            // arrivals per second
+    double duration;        // in seconds, per sweep step
+    double interval;        // report every interval seconds, =0: off
+    uint8_t steps;          // sweep: double the rate steps times, =0: off
+} load_config_t;
+
+typedef struct {
+    uint64_t samples[LOAD_NB_OF_SAMPLES];
+    uint64_t count;
+    uint64_t max;
+} load_latency_t;
+
+typedef struct {
+    uint64_t offered;       // planned arrivals
+    uint64_t arrivals;      // planned arrivals sent as events, the rest arm timer events
+    uint64_t sent;          // events and timer events the scheduler accepted
+    uint64_t handled;       // task function calls
+    uint64_t dropped;       // main_fifo full
+    uint64_t timer_dropped; // timer events full
+    uint64_t timer_armed;
+    uint64_t timer_fired;
+    uint16_t main_fifo_high;
+    uint16_t group_fifo_high; // fullest fifo of the event groups 1, 2, ...
+    uint16_t timer_high;
+    uint64_t interval_max;  // max. latency since the last report
+    load_latency_t events;
+    load_latency_t timers;
+} load_stats_t;
+
+static load_config_t load_cfg = {
+    .nb_of_tasks = 4,
+    .arrival = LOAD_ARRIVAL_POISSON,
+    .timeout_max = 10,
+    .burst = 8,
+    .rate = 10000,
+    .duration = 5,
+};
+static load_stats_t load_stats;
+static scheduler_ctx_t load_ctx;
+static task_t load_task[LOAD_NB_OF_TASKS_MAX];
+static char load_task_name[LOAD_NB_OF_TASKS_MAX][8];
+static uint64_t load_start_ns;
+static uint64_t load_rnd = 88172645463325252ull;
+
+// - helpers -------------------------------------------------------------------
+static uint64_t load_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t load_random(void) {
+    // xorshift64
+    load_rnd ^= load_rnd << 13;
+    load_rnd ^= load_rnd >> 7;
+    load_rnd ^= load_rnd << 17;
+    return load_rnd;
+}
+
+/**
+ * @return  uniform in (0, 1]
+ */
+static double load_random_unit(void) {
+    return ((double)(load_random() >> 11) + 1.0) / 9007199254740992.0;
+}
+
+static void *load_time_pack(uint64_t ns) {
+    return (void *)(uintptr_t)(((ns - load_start_ns) >> LOAD_TIME_SHIFT) & LOAD_TIME_MASK);
+}
+
+/**
+ * @return  ns from the planned time in data until now
+ */
+static uint64_t load_time_since(void *data) {
+    uint64_t now = ((load_time_ns() - load_start_ns) >> LOAD_TIME_SHIFT) & LOAD_TIME_MASK;
+    uint64_t diff = (now - (uint64_t)(uintptr_t)data) & LOAD_TIME_MASK;
+    if(diff > (LOAD_TIME_MASK >> 1)) {
+        // a timer event can run up to 1 tick early
+        diff = 0;
+    }
+    return diff << LOAD_TIME_SHIFT;
+}
+
+static uint16_t load_fifo_used(fifo_t *f) {
+    return (uint16_t)((f->wr + f->size - f->rd) % f->size);
+}
+
+static void load_note_queues(void) {
+    uint16_t used;
+    uint8_t n;
+    if((used = load_fifo_used(&load_ctx.events.main_fifo)) > load_stats.main_fifo_high) {
+        load_stats.main_fifo_high = used;
+    }
+    for(n = 0; n < (EVENTS_NB_OF_GROUPS - 1); n++) {
+        if((used = load_fifo_used(&load_ctx.events.group_fifo[n])) > load_stats.group_fifo_high) {
+            load_stats.group_fifo_high = used;
+        }
+    }
+    if((used = load_fifo_used(&load_ctx.events.timer_fifo)) > load_stats.timer_high) {
+        load_stats.timer_high = used;
+    }
+}
+
+static void load_latency_add(load_latency_t *l, uint64_t ns) {
+    uint64_t n;
+    if(ns > l->max) {
+        l->max = ns;
+    }
+    if(ns > load_stats.interval_max) {
+        load_stats.interval_max = ns;
+    }
+    if(l->count < LOAD_NB_OF_SAMPLES) {
+        l->samples[l->count] = ns;
+    }
+    else if((n = load_random() % (l->count + 1)) < LOAD_NB_OF_SAMPLES) {
+        // reservoir sampling, every sample has the same chance to stay
+        l->samples[n] = ns;
+    }
+    l->count++;
+}
+
+static int load_cmp(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * sort the samples, call once before load_latency_get()
+ */
+static void load_latency_sort(load_latency_t *l) {
+    uint64_t n = (l->count < LOAD_NB_OF_SAMPLES) ? l->count : LOAD_NB_OF_SAMPLES;
+    qsort(l->samples, n, sizeof(uint64_t), load_cmp);
+}
+
+/**
+ * @param   permille    500: median, 990: p99, 999: p99.9
+ * @return  latency in ns
+ */
+static uint64_t load_latency_get(load_latency_t *l, uint16_t permille) {
+    uint64_t n = (l->count < LOAD_NB_OF_SAMPLES) ? l->count : LOAD_NB_OF_SAMPLES;
+    if(n == 0) {
+        return 0;
+    }
+    return l->samples[(n - 1) * permille / 1000];
+}
+
+static void load_work(void) {
+    uint64_t end;
+    if(load_cfg.work_ns == 0) {
+        return;
+    }
+    end = load_time_ns() + load_cfg.work_ns;
+    while(load_time_ns() < end);
+}
+
+// - load tasks ----------------------------------------------------------------
+static int8_t load_task_func(uint8_t event, void *data) {
+    uint8_t n, pos, tid;
+
+    switch(event) {
+        case LOAD_EV_ARRIVAL:
+        case LOAD_EV_FANOUT:
+            load_latency_add(&load_stats.events, load_time_since(data));
+            break;
+        case LOAD_EV_TIMER:
+            load_latency_add(&load_stats.timers, load_time_since(data));
+            load_stats.timer_fired++;
+            break;
+        default:
+            return 1;
+    }
+    load_stats.handled++;
+    load_work();
+    if((event == LOAD_EV_ARRIVAL) && (load_cfg.publish == false)) {
+        // forward to the next tasks, the planned time stays the same
+        tid = scheduler_ctx_get_current_tid(&load_ctx);
+        for(pos = 0; (pos < load_cfg.nb_of_tasks) && (load_task[pos].tid != tid); pos++);
+        for(n = 1; n <= load_cfg.fanout; n++) {
+            if(scheduler_ctx_send_event(&load_ctx, load_task[(pos + n) % load_cfg.nb_of_tasks].tid, LOAD_EV_FANOUT, data) == false) {
+                load_stats.dropped++;
+            }
+        }
+        load_note_queues();
+    }
+    return 1;
+}
+
+// - generator -----------------------------------------------------------------
+/**
+ * @return  ns from this arrival (burst) to the next one
+ */
+static double load_next_gap_ns(double rate) {
+    switch(load_cfg.arrival) {
+        case LOAD_ARRIVAL_BURSTY:
+            // bursts arrive as a poisson process
+            return -log(load_random_unit()) * 1e9 * load_cfg.burst / rate;
+        case LOAD_ARRIVAL_UNIFORM:
+            return 1e9 / rate;
+        default:
+            return -log(load_random_unit()) * 1e9 / rate;
+    }
+}
+
+static void load_emit(uint64_t planned_ns) {
+    uint8_t tid = load_task[load_random() % load_cfg.nb_of_tasks].tid;
+    uint32_t timeout;
+    int8_t ok;
+
+    load_stats.offered++;
+    if((load_random() % 100) < load_cfg.timer_percent) {
+        timeout = 1 + (uint32_t)(load_random() % load_cfg.timeout_max);
+        ok = scheduler_ctx_add_timer_event(&load_ctx, timeout, tid, LOAD_EV_TIMER,
+            load_time_pack(planned_ns + timeout * (1000000000ull / EV_TIMER_TICK_HZ)));
+        if(ok == false) {
+            load_stats.timer_dropped++;
+        }
+        else {
+            load_stats.timer_armed++;
+        }
+    }
+    else if(load_cfg.publish) {
+        load_stats.arrivals++;
+        ok = scheduler_ctx_publish(&load_ctx, LOAD_EV_ARRIVAL, load_time_pack(planned_ns));
+        if(ok == false) {
+            load_stats.dropped++;
+        }
+    }
+    else {
+        load_stats.arrivals++;
+        ok = scheduler_ctx_send_event(&load_ctx, tid, LOAD_EV_ARRIVAL, load_time_pack(planned_ns));
+        if(ok == false) {
+            load_stats.dropped++;
+        }
+    }
+    if(ok) {
+        load_stats.sent++;
+    }
+    load_note_queues();
+}
+
+static void load_setup(void) {
+    uint8_t n;
+
+    memset(&load_stats, 0, sizeof(load_stats));
+    // a sweep sets the instance up again for every step
+    scheduler_ctx_destroy(&load_ctx);
+    scheduler_ctx_init(&load_ctx);
+    scheduler_ctx_start_event_timer(&load_ctx);
+    for(n = 0; n < load_cfg.nb_of_tasks; n++) {
+        snprintf(load_task_name[n], sizeof(load_task_name[n]), "LOAD%d", n);
+        memset(&load_task[n], 0, sizeof(task_t));
+        load_task[n].task = load_task_func;
+        load_task[n].name = load_task_name[n];
+        if((scheduler_ctx_add_task(&load_ctx, &load_task[n]) == false) ||
+           (scheduler_ctx_start_task(&load_ctx, load_task[n].tid) == false)) {
+            printf("error: could not add task %d\n", n);
+            exit(1);
+        }
+        if(load_cfg.publish) {
+            scheduler_ctx_subscribe(&load_ctx, load_task[n].tid, LOAD_EV_ARRIVAL);
+        }
+    }
+    while(scheduler_ctx_run_once(&load_ctx) == true);
+}
+
+static void load_print_interval(double t, load_stats_t *last) {
+    printf("  %7.1f s: %9.0f ev/s handled, dropped: %llu, timer dropped: %llu, main_fifo high: %d, max latency: %llu us\n",
+        t, (double)(load_stats.handled - last->handled) / load_cfg.interval,
+        (unsigned long long)(load_stats.dropped - last->dropped),
+        (unsigned long long)(load_stats.timer_dropped - last->timer_dropped),
+        load_stats.main_fifo_high, (unsigned long long)(load_stats.interval_max / 1000));
+    fflush(stdout);
+    last->handled = load_stats.handled;
+    last->dropped = load_stats.dropped;
+    last->timer_dropped = load_stats.timer_dropped;
+    load_stats.interval_max = 0;
+}
+
+/**
+ * the event timer follows the wall clock
+ * @param   now     current time in ns
+ * @param   ticked  ticks given to the event timer so far, updated
+ */
+static void load_timer_follow(uint64_t now, uint64_t *ticked) {
+#ifndef EV_TIMER_HOST_CLOCK
+    uint64_t due_ticks = (now - load_start_ns) * EV_TIMER_TICK_HZ / 1000000000ull;
+    if(due_ticks > *ticked) {
+        events_ctx_timer_tick(&load_ctx.events, (uint32_t)(due_ticks - *ticked));
+        *ticked = due_ticks;
+    }
+#else
+    // host port: due timer events, as power_mode_sleep() does
+    events_ctx_timer_poll(&load_ctx.events);
+    (void)now;
+    (void)ticked;
+#endif
+}
+
+/**
+ * run the load for the configured duration
+ * @return  elapsed time in seconds
+ */
+static double load_run(double rate) {
+    uint64_t now, end, next_ns, report_ns = 0, ticked = 0;
+    uint32_t n;
+    load_stats_t last;
+
+    load_setup();
+    memset(&last, 0, sizeof(last));
+    load_start_ns = load_time_ns();
+    end = load_start_ns + (uint64_t)(load_cfg.duration * 1e9);
+    next_ns = load_start_ns + (uint64_t)load_next_gap_ns(rate);
+    if(load_cfg.interval > 0) {
+        report_ns = load_start_ns + (uint64_t)(load_cfg.interval * 1e9);
+    }
+    while((now = load_time_ns()) < end) {
+        load_timer_follow(now, &ticked);
+        // all arrivals due by now, at their planned time
+        while(next_ns <= now) {
+            n = (load_cfg.arrival == LOAD_ARRIVAL_BURSTY) ? load_cfg.burst : 1;
+            while(n--) {
+                load_emit(next_ns);
+            }
+            next_ns += (uint64_t)load_next_gap_ns(rate);
+        }
+        scheduler_ctx_run_once(&load_ctx);
+        if(report_ns && (now >= report_ns)) {
+            load_print_interval((double)(now - load_start_ns) / 1e9, &last);
+            report_ns += (uint64_t)(load_cfg.interval * 1e9);
+        }
+    }
+    // finish the queued events and let the armed timer events expire, not counted in the time
+    now = load_time_ns();
+    end = now + (load_cfg.timeout_max + 2) * (1000000000ull / EV_TIMER_TICK_HZ);
+    while((scheduler_ctx_run_once(&load_ctx) == true) ||
+          ((load_stats.timer_fired < load_stats.timer_armed) && (load_time_ns() < end))) {
+        load_timer_follow(load_time_ns(), &ticked);
+    }
+    return (double)(now - load_start_ns) / 1e9;
+}
+
+static void load_print_latency(const char *name, load_latency_t *l) {
+    load_latency_sort(l);
+    printf(" %-12s p50: %8.1f us, p99: %8.1f us, p99.9: %8.1f us, max: %8.1f us (%llu samples)\n", name,
+        load_latency_get(l, 500) / 1e3, load_latency_get(l, 990) / 1e3, load_latency_get(l, 999) / 1e3,
+        l->max / 1e3, (unsigned long long)l->count);
+}
+
+static void load_print_summary(double elapsed) {
+    events_timer_stats_t ts;
+#ifdef EVENTS_LATENCY_ON
+    uint8_t n;
+#endif
+
+    printf(" offered:      %9.0f ev/s (%llu arrivals)\n", load_stats.offered / elapsed, (unsigned long long)load_stats.offered);
+    printf(" handled:      %9.0f ev/s (%llu task calls, with fan-out)\n", load_stats.handled / elapsed, (unsigned long long)load_stats.handled);
+    printf(" dropped:      %llu events (main_fifo full), %llu timer events (timer events full)\n",
+        (unsigned long long)load_stats.dropped, (unsigned long long)load_stats.timer_dropped);
+    printf(" high-water:   main_fifo %d of %d, group fifos %d of %d, timer events %d of %d\n",
+        load_stats.main_fifo_high, EVENTS_MAIN_FIFO_SIZE - 1, load_stats.group_fifo_high, EVENTS_GROUP_FIFO_SIZE - 1,
+        load_stats.timer_high, EV_TIMER_NB_EVENTS - 1);
+    load_print_latency("events:", &load_stats.events);
+    load_print_latency("timer events:", &load_stats.timers);
+    if(events_ctx_get_timer_stats(&load_ctx.events, &ts)) {
+        printf(" event timer:  %u expired, %u late, max. lateness %llu ticks\n",
+            ts.expired, ts.late, (unsigned long long)ts.lateness_max);
+    }
+#ifdef EVENTS_LATENCY_ON
+    for(n = 0; n < load_cfg.nb_of_tasks; n++) {
+        printf(" %-6s queue p99: %u ns, runtime p99: %u ns\n", load_task[n].name,
+            scheduler_ctx_get_task_latency(&load_ctx, load_task[n].tid, SCHEDULER_LATENCY_QUEUE, 990),
+            scheduler_ctx_get_task_latency(&load_ctx, load_task[n].tid, SCHEDULER_LATENCY_EXEC, 990));
+    }
+#endif
+}
+
+/**
+ * saturated: events dropped or less than 95 % of the offered load handled,
+ * an arrival event makes 1 + fanout task calls (publish: 1 per task), a timer
+ * event makes 1 and is not forwarded
+ */
+static int8_t load_is_saturated(void) {
+    double expected = (double)load_stats.arrivals * (load_cfg.publish ? load_cfg.nb_of_tasks : (1 + load_cfg.fanout)) +
+        (double)load_stats.timer_armed;
+    return (load_stats.dropped > 0) || (load_stats.timer_dropped > 0) || (load_stats.handled < expected * 0.95);
+}
+
+static void load_usage(void) {
+    printf("usage: scheduler_load [options]\n"
+           " -t tasks     number of load tasks, 1 ... %d (default 4)\n"
+           " -r rate      arrivals per second (default 10000)\n"
+           " -a arrival   poisson, bursty or uniform (default poisson)\n"
+           " -b burst     events per burst with -a bursty (default 8)\n"
+           " -m percent   share of arrivals that arm a timer event instead (default 0)\n"
+           " -T ticks     timer events expire after 1 ... ticks (default 10, %d ticks/s)\n"
+           " -f fanout    each arrival is forwarded to the next fanout tasks (default 0)\n"
+           " -P           publish the arrivals to all tasks instead\n"
+           " -w ns        busy time per task call (default 0)\n"
+           " -d seconds   duration of the run, or of each sweep step (default 5)\n"
+           " -i seconds   report every interval (default off)\n"
+           " -s steps     sweep: double the rate steps times, report where it saturates\n",
+           LOAD_NB_OF_TASKS_MAX, (int)EV_TIMER_TICK_HZ);
+}
+
+int main(int argc, char *argv[]) {
+    double rate, elapsed, good_rate = 0;
+    uint8_t step;
+    int opt;
+
+    while((opt = getopt(argc, argv, "t:r:a:b:m:T:f:Pw:d:i:s:h")) != -1) {
+        switch(opt) {
+            case 't': load_cfg.nb_of_tasks = (uint8_t)atoi(optarg); break;
+            case 'r': load_cfg.rate = atof(optarg); break;
+            case 'a':
+                if(strcmp(optarg, "bursty") == 0) load_cfg.arrival = LOAD_ARRIVAL_BURSTY;
+                else if(strcmp(optarg, "uniform") == 0) load_cfg.arrival = LOAD_ARRIVAL_UNIFORM;
+                else load_cfg.arrival = LOAD_ARRIVAL_POISSON;
+                break;
+            case 'b': load_cfg.burst = (uint32_t)atoi(optarg); break;
+            case 'm': load_cfg.timer_percent = (uint8_t)atoi(optarg); break;
+            case 'T': load_cfg.timeout_max = (uint32_t)atoi(optarg); break;
+            case 'f': load_cfg.fanout = (uint8_t)atoi(optarg); break;
+            case 'P': load_cfg.publish = true; break;
+            case 'w': load_cfg.work_ns = (uint32_t)atoi(optarg); break;
+            case 'd': load_cfg.duration = atof(optarg); break;
+            case 'i': load_cfg.interval = atof(optarg); break;
+            case 's': load_cfg.steps = (uint8_t)atoi(optarg); break;
+            default: load_usage(); return 1;
+        }
+    }
+    if((load_cfg.nb_of_tasks < 1) || (load_cfg.nb_of_tasks > LOAD_NB_OF_TASKS_MAX) ||
+       (load_cfg.rate <= 0) || (load_cfg.duration <= 0) || (load_cfg.burst < 1) ||
+       (load_cfg.timeout_max < 1) || (load_cfg.fanout >= load_cfg.nb_of_tasks && load_cfg.fanout > 0)) {
+        printf("error: invalid options\n");
+        load_usage();
+        return 1;
+    }
+    printf("load: %d tasks, %.0f arrivals/s, %s (burst %u), %d %% timer events, fan-out %d%s, work %u ns\n",
+        load_cfg.nb_of_tasks, load_cfg.rate,
+        (load_cfg.arrival == LOAD_ARRIVAL_BURSTY) ? "bursty" : (load_cfg.arrival == LOAD_ARRIVAL_UNIFORM) ? "uniform" : "poisson",
+        (load_cfg.arrival == LOAD_ARRIVAL_BURSTY) ? load_cfg.burst : 1,
+        load_cfg.timer_percent, load_cfg.fanout, load_cfg.publish ? " (publish)" : "", load_cfg.work_ns);
+    printf(" main_fifo: %d events, timer events: %d, sizeof(event_t): %d bytes\n",
+        EVENTS_MAIN_FIFO_SIZE, EV_TIMER_NB_EVENTS, (int)sizeof(event_t));
+
+    if(load_cfg.steps == 0) {
+        elapsed = load_run(load_cfg.rate);
+        printf("result after %.1f s:\n", elapsed);
+        load_print_summary(elapsed);
+        return 0;
+    }
+    // sweep
+    printf(" %12s %12s %12s %10s %10s %10s %10s\n", "offered/s", "handled/s", "dropped", "fifo high", "p50 us", "p99 us", "p99.9 us");
+    for(step = 0, rate = load_cfg.rate; step < load_cfg.steps; step++, rate *= 2) {
+        elapsed = load_run(rate);
+        load_latency_sort(&load_stats.events);
+        printf(" %12.0f %12.0f %12llu %10d %10.1f %10.1f %10.1f%s\n",
+            load_stats.offered / elapsed, load_stats.handled / elapsed,
+            (unsigned long long)(load_stats.dropped + load_stats.timer_dropped), load_stats.main_fifo_high,
+            load_latency_get(&load_stats.events, 500) / 1e3, load_latency_get(&load_stats.events, 990) / 1e3,
+            load_latency_get(&load_stats.events, 999) / 1e3,
+            load_is_saturated() ? "  saturated" : "");
+        fflush(stdout);
+        if(load_is_saturated()) {
+            break;
+        }
+        good_rate = rate;
+    }
+    if(step == load_cfg.steps) {
+        printf("not saturated up to %.0f arrivals/s\n", good_rate);
+    }
+    else if(good_rate > 0) {
+        printf("saturates between %.0f and %.0f arrivals/s\n", good_rate, rate);
+    }
+    else {
+        printf("saturated at %.0f arrivals/s already\n", rate);
+    }
+    return 0;
+}
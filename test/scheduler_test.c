@@ -3,14 +3,24 @@
  * 2024-09-28
  * scheduler https://github.com/mwuerms/mmschedule
  * testing scheduler functions
- * + compile from main folder: gcc scheduler.c events.c power_mode.c fifo.c test/scheduler_test.c test/test.c -o test/scheduler_test
+ * + compile from main folder: gcc scheduler.c events.c events_ext.c power_mode.c fifo.c dlog.c channel.c snapshot.c events_shm.c events_shm_client.c test/scheduler_test.c test/test.c -o test/scheduler_test
+ * + with the snapshot test: add -DSNAPSHOT_ON, with the latency test: add -DEVENTS_LATENCY_ON
+ * + with the replay test: add replay.c and -DREPLAY_ON
  * + run from main folder: ./test/scheduler_test
  */
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/time.h>
 #include "test.h"
 
 // code under test
 #include "../scheduler.h"
+#include "../dlog.h"
+#include "../channel.h"
+#include "../snapshot.h"
+#include "../replay.h"
 
 char *get_bool_string(uint8_t b) {
     if(b == true)
@@ -18,6 +28,42 @@ char *get_bool_string(uint8_t b) {
     return "false";
 }
 
+// with the host clock a tick boundary cannot be hit exactly, any delay moves the
+// clock on: checks that a timer event is not yet due only hold with exact ticks
+#ifdef EV_TIMER_HOST_CLOCK
+#define TEST_TICKS_EXACT (false)
+#else
+#define TEST_TICKS_EXACT (true)
+#endif
+
+/**
+ * let ticks pass on the event timer: tick it, or with EV_TIMER_HOST_CLOCK wait
+ * for the host clock (events_ctx_timer_tick() does not move it) and poll it
+ */
+static void test_timer_advance(events_ctx_t *e, uint32_t ticks) {
+#ifdef EV_TIMER_HOST_CLOCK
+    uint64_t until = events_ctx_get_clock_ticks(e) + ticks;
+    while(events_ctx_get_clock_ticks(e) < until) {
+        usleep(100);
+    }
+    events_ctx_timer_poll(e);
+#else
+    events_ctx_timer_tick(e, ticks);
+#endif
+}
+
+#if defined(SNAPSHOT_ON) || defined(REPLAY_ON)
+/**
+ * path of a scratch file of this test run, in $TMPDIR or /tmp, with the pid so
+ * test runs in parallel do not share it
+ */
+static char *test_tmp_path(char *path, size_t size, const char *name) {
+    const char *dir = getenv("TMPDIR");
+    snprintf(path, size, "%s/%s-%d", ((dir != NULL) && (dir[0] != 0)) ? dir : "/tmp", name, (int)getpid());
+    return path;
+}
+#endif
+
 static uint8_t test01_tid, test02_tid;
 static uint16_t test_run_count;
 
@@ -57,6 +103,15 @@ static int8_t test02_task_func (uint8_t event, void *data) {
 }
 static task_t test02_task = {.task = test02_task_func, .name = "TEST02_TASK"};
 
+static int8_t test03_task_func (uint8_t event, void *data) {
+    printf("called test03_task_func(%d, %p)\n", event, data);
+    if(event == EV_STOP) {
+        printf(" + STOP test03_task\n");
+    }
+    return 1;
+}
+static task_t test03_task = {.task = test03_task_func, .name = "TEST03_TASK"};
+
 
 // - test cases ----------------------------------------------------------------
 int8_t test01(void) {
@@ -284,11 +339,1231 @@ int8_t test06(void) {
     return TEST_SUCCESSFUL;
 }
 
+int8_t test07(void) {
+    uint8_t test_nr, ev;
+    int8_t res, res_should;
+    printf(" + test07: scheduler_subscribe(), scheduler_publish()\n");
+
+    ev = 40;
+    test_nr = 1;
+    printf("   %02d: scheduler_subscribe(%d, %d)\n", test_nr, test01_tid, ev);
+    res_should = true;
+    res = scheduler_subscribe(test01_tid, ev);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+
+    test_nr++;
+    printf("   %02d: scheduler_subscribe(%d, %d)\n", test_nr, test02_tid, ev);
+    res_should = true;
+    res = scheduler_subscribe(test02_tid, ev);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+
+    test_nr++;
+    printf("   %02d: scheduler_subscribe(%d, %d), should fail, no such task\n", test_nr, 99, ev);
+    res_should = false;
+    res = scheduler_subscribe(99, ev);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+
+    test_nr++;
+    printf("   %02d: scheduler_unsubscribe(%d, %d), should fail, not subscribed\n", test_nr, test01_tid, ev+1);
+    res_should = false;
+    res = scheduler_unsubscribe(test01_tid, ev+1);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+
+    test_nr++;
+    printf("   %02d: scheduler_publish(%d)\n", test_nr, ev);
+    res_should = true;
+    res = scheduler_publish(ev, NULL);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+    return TEST_SUCCESSFUL;
+}
+
+int8_t test08(void) {
+    uint8_t test_nr, tid;
+    int8_t res, res_should;
+    printf(" + test08: scheduler_stop_task(), scheduler_remove_task()\n");
+
+    test_nr = 1;
+    printf("   %02d: scheduler_add_task(%s), scheduler_start_task()\n", test_nr, test03_task.name);
+    res_should = true;
+    res = scheduler_add_task(&test03_task);
+    if(res == true) {
+        res = scheduler_start_task(test03_task.tid);
+    }
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+    tid = test03_task.tid;
+    scheduler_send_event(tid, 5, NULL);
+    scheduler_add_timer_event(10, tid, 6, NULL);
+
+    test_nr++;
+    printf("   %02d: scheduler_stop_task(%d)\n", test_nr, tid);
+    res_should = true;
+    res = scheduler_stop_task(tid);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+
+    test_nr++;
+    printf("   %02d: scheduler_stop_task(%d), should fail, already stopped\n", test_nr, tid);
+    res_should = false;
+    res = scheduler_stop_task(tid);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+
+    test_nr++;
+    printf("   %02d: scheduler_remove_task(%s)\n", test_nr, test03_task.name);
+    res_should = true;
+    res = scheduler_remove_task(&test03_task);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+
+    test_nr++;
+    printf("   %02d: scheduler_remove_task(%s), should fail, already removed\n", test_nr, test03_task.name);
+    res_should = false;
+    res = scheduler_remove_task(&test03_task);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+
+    test_nr++;
+    printf("   %02d: scheduler_start_task(%d), should fail, no such task\n", test_nr, tid);
+    res_should = false;
+    res = scheduler_start_task(tid);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+    return TEST_SUCCESSFUL;
+}
+
+static scheduler_ctx_t test09_ctx;
+static uint16_t test09_count;
+static int8_t test09_task_func (uint8_t event, void *data) {
+    printf("test09_task_func(event: %d)\n", event);
+    test09_count++;
+    return 1;
+}
+static task_t test09_task = {.task = test09_task_func, .name = "TEST09_TASK"};
+
+int8_t test09(void) {
+    uint8_t test_nr;
+    int8_t res, res_should;
+    printf(" + test09: scheduler_ctx_init(), 2nd scheduler instance\n");
+
+    test_nr = 1;
+    printf("   %02d: scheduler_ctx_add_task(%s), own tids\n", test_nr, test09_task.name);
+    scheduler_ctx_init(&test09_ctx);
+    res_should = true;
+    // tid 1: event timer task of this instance
+    res = (scheduler_ctx_add_task(&test09_ctx, &test09_task) == true) && (test09_task.tid == 2);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+
+    test_nr++;
+    printf("   %02d: scheduler_ctx_start_task(%d), scheduler_ctx_run_once()\n", test_nr, test09_task.tid);
+    res_should = true;
+    test09_count = 0;
+    scheduler_ctx_start_task(&test09_ctx, test09_task.tid);
+    scheduler_ctx_send_event(&test09_ctx, test09_task.tid, 9, NULL);
+    while(scheduler_ctx_run_once(&test09_ctx) == true);
+    res = (test09_count == 2) && (scheduler_ctx_is_event_main_fifo_empty(&test09_ctx) == true);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+
+    return TEST_SUCCESSFUL;
+}
+
+static uint16_t test10_calls;
+static void test10_defer_func(void *arg) {
+    printf("test10_defer_func(arg: %p)\n", arg);
+    test10_calls += (uint16_t)(uintptr_t)arg;
+}
+
+int8_t test10(void) {
+    uint8_t test_nr;
+    int8_t res, res_should;
+    printf(" + test10: scheduler_ctx_defer(), scheduler_ctx_defer_after()\n");
+
+    test_nr = 1;
+    printf("   %02d: scheduler_ctx_defer(), 2 calls\n", test_nr);
+    res_should = true;
+    test10_calls = 0;
+    res = scheduler_ctx_defer(&test09_ctx, test10_defer_func, (void *)1) &&
+          scheduler_ctx_defer(&test09_ctx, test10_defer_func, (void *)2);
+    while(scheduler_ctx_run_once(&test09_ctx) == true);
+    res = res && (test10_calls == 3);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+
+    test_nr++;
+    printf("   %02d: scheduler_ctx_defer_after(2), called after 2 ticks\n", test_nr);
+    res_should = true;
+    test10_calls = 0;
+    scheduler_ctx_start_event_timer(&test09_ctx);
+    while(scheduler_ctx_run_once(&test09_ctx) == true);
+    res = scheduler_ctx_defer_after(&test09_ctx, 2, test10_defer_func, (void *)4);
+    test_timer_advance(&test09_ctx.events, 1);
+    while(scheduler_ctx_run_once(&test09_ctx) == true);
+    res = res && ((TEST_TICKS_EXACT == false) || (test10_calls == 0));
+    test_timer_advance(&test09_ctx.events, 1);
+    while(scheduler_ctx_run_once(&test09_ctx) == true);
+    res = res && (test10_calls == 4);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+
+    test_nr++;
+    printf("   %02d: scheduler_ctx_cancel_timer_events(SCHEDULER_TID_DEFER), frees the deferred calls\n", test_nr);
+    res_should = true;
+    test10_calls = 0;
+    res = true;
+    for(uint8_t n = 0; n < NB_OF_DEFER_CALLS; n++) {
+        res = res && scheduler_ctx_defer_after(&test09_ctx, 100, test10_defer_func, (void *)8);
+    }
+    res = res && (scheduler_ctx_defer_after(&test09_ctx, 100, test10_defer_func, (void *)8) == false);
+    res = res && (scheduler_ctx_cancel_timer_events(&test09_ctx, SCHEDULER_TID_DEFER, EV_ANY) == NB_OF_DEFER_CALLS);
+    res = res && scheduler_ctx_defer(&test09_ctx, test10_defer_func, (void *)8);
+    while(scheduler_ctx_run_once(&test09_ctx) == true);
+    res = res && (test10_calls == 8);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+
+    test_nr++;
+    printf("   %02d: scheduler_ctx_defer(NULL), should fail\n", test_nr);
+    res_should = false;
+    res = scheduler_ctx_defer(&test09_ctx, NULL, NULL);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+    return TEST_SUCCESSFUL;
+}
+
+static uint16_t test11_calls, test11_events, test11_sum;
+static int8_t test11_task_func (uint8_t event, void *data) {
+    printf("test11_task_func(event: %d)\n", event);
+    return 1;
+}
+static int8_t test11_batch_func (event_t *ev, uint16_t count) {
+    uint16_t n;
+    printf("test11_batch_func(count: %d)\n", count);
+    test11_calls++;
+    for(n = 0; n < count; n++) {
+        printf("  ev[%d]: %d, data: %p\n", n, ev[n].event, EVENT_DATA_UNPACK(ev[n].data));
+        test11_events++;
+        test11_sum += (uint16_t)(uintptr_t)EVENT_DATA_UNPACK(ev[n].data);
+    }
+    return 1;
+}
+static task_t test11_task = {.task = test11_task_func, .batch = test11_batch_func, .name = "TEST11_TASK"};
+
+int8_t test11(void) {
+    uint8_t test_nr = 1, n;
+    int8_t res, res_should;
+    printf(" + test11: batch handler, task_t.batch\n");
+
+    printf("   %02d: scheduler_ctx_send_event() 3x, 1 call of the batch handler\n", test_nr);
+    res_should = true;
+    test11_calls = 0;
+    test11_events = 0;
+    test11_sum = 0;
+    res = scheduler_ctx_add_task(&test09_ctx, &test11_task) &&
+          scheduler_ctx_start_task(&test09_ctx, test11_task.tid);
+    for(n = 1; n <= 3; n++) {
+        res = res && scheduler_ctx_send_event(&test09_ctx, test11_task.tid, n, (void *)(uintptr_t)n);
+    }
+    while(scheduler_ctx_run_once(&test09_ctx) == true);
+    // EV_START and 3 events in 1 call
+    res = res && (test11_calls == 1) && (test11_events == 4) && (test11_sum == 6);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+
+    test_nr++;
+    printf("   %02d: more events than NB_OF_BATCH_EVENTS, several calls\n", test_nr);
+    res_should = true;
+    test11_calls = 0;
+    test11_events = 0;
+    for(n = 0; n < NB_OF_BATCH_EVENTS + 2; n++) {
+        res = scheduler_ctx_send_event(&test09_ctx, test11_task.tid, 1, NULL);
+    }
+    while(scheduler_ctx_run_once(&test09_ctx) == true);
+    res = res && (test11_calls == 2) && (test11_events == NB_OF_BATCH_EVENTS + 2);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+    return TEST_SUCCESSFUL;
+}
+
+int8_t test12(void) {
+    uint8_t test_nr = 1, n;
+    uint16_t armed;
+    int8_t res, res_should;
+    events_timer_stats_t stats;
+    printf(" + test12: scheduler_ctx_add_timer_event_from_isr(), scheduler_ctx_cancel_timer_events_from_isr()\n");
+
+    printf("   %02d: stage 2 timer events, cancel 1, called after 2 ticks\n", test_nr);
+    res_should = true;
+    test09_count = 0;
+    res = scheduler_ctx_add_timer_event_from_isr(&test09_ctx, 2, test09_task.tid, 12, NULL) &&
+          scheduler_ctx_add_timer_event_from_isr(&test09_ctx, 2, test09_task.tid, 13, NULL) &&
+          scheduler_ctx_cancel_timer_events_from_isr(&test09_ctx, test09_task.tid, 13);
+    while(scheduler_ctx_run_once(&test09_ctx) == true);
+    test_timer_advance(&test09_ctx.events, 1);
+    while(scheduler_ctx_run_once(&test09_ctx) == true);
+    res = res && ((TEST_TICKS_EXACT == false) || (test09_count == 0));
+    test_timer_advance(&test09_ctx.events, 1);
+    while(scheduler_ctx_run_once(&test09_ctx) == true);
+    res = res && (test09_count == 1);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+
+    test_nr++;
+    printf("   %02d: stage ring full, should fail\n", test_nr);
+    res_should = false;
+    res = true;
+    for(n = 0; n < EV_TIMER_STAGE_SIZE; n++) {
+        res = res && scheduler_ctx_add_timer_event_from_isr(&test09_ctx, 10, test09_task.tid, 12, NULL);
+    }
+    res = res && scheduler_ctx_add_timer_event_from_isr(&test09_ctx, 10, test09_task.tid, 12, NULL);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+
+    test_nr++;
+    printf("   %02d: scheduler_ctx_cancel_timer_events(EV_ANY) after the merge\n", test_nr);
+    res_should = true;
+    while(scheduler_ctx_run_once(&test09_ctx) == true);
+    res = (scheduler_ctx_cancel_timer_events(&test09_ctx, test09_task.tid, EV_ANY) == EV_TIMER_STAGE_SIZE);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+
+    test_nr++;
+    printf("   %02d: timer events full, a staged timer event is lost at the merge, counted in the stats\n", test_nr);
+    res_should = true;
+    for(armed = 0; scheduler_ctx_add_timer_event(&test09_ctx, 1000, test09_task.tid, 12, NULL) == true; armed++);
+    events_ctx_reset_timer_stats(&test09_ctx.events);
+    res = scheduler_ctx_add_timer_event_from_isr(&test09_ctx, 10, test09_task.tid, 13, NULL);
+    while(scheduler_ctx_run_once(&test09_ctx) == true);
+    res = res && events_ctx_get_timer_stats(&test09_ctx.events, &stats);
+    printf("       armed: %d, staged lost: %u\n", armed, stats.staged_lost);
+    res = res && (stats.staged_lost == 1) &&
+          (scheduler_ctx_cancel_timer_events(&test09_ctx, test09_task.tid, 13) == 0) &&
+          (scheduler_ctx_cancel_timer_events(&test09_ctx, test09_task.tid, EV_ANY) == armed);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+    return TEST_SUCCESSFUL;
+}
+
+int8_t test13(void) {
+    uint8_t test_nr = 1, n;
+    int8_t res, res_should;
+    uint32_t dropped;
+    dlog_record_t rec;
+    static const char fmt[] = "test13: %llu, %llu\n";
+    printf(" + test13: dlog_write(), dlog_read(), deferred logging\n");
+
+    printf("   %02d: dlog_write(), read the raw record\n", test_nr);
+    res_should = true;
+    while(dlog_read(NULL) == true);
+    dlog_write(DLOG_LEVEL_WARN, fmt, 13, 0x1234, 0);
+    res = (dlog_read(&rec) == true) && (rec.fmt == fmt) && (rec.level == DLOG_LEVEL_WARN) &&
+          (rec.arg[0] == 13) && (rec.arg[1] == 0x1234) && (dlog_read(&rec) == false);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+
+    test_nr++;
+    printf("   %02d: ring full, records are dropped, dlog_flush()\n", test_nr);
+    res_should = true;
+    dropped = dlog_get_dropped();
+    for(n = 0; n < DLOG_RING_SIZE + 2; n++) {
+        dlog_write(DLOG_LEVEL_ERROR, fmt, n, 0, 0);
+    }
+    res = (dlog_get_dropped() - dropped == 2) && (dlog_flush(2) == 2);
+    for(n = 0; dlog_read(NULL) == true; n++);
+    res = res && (n == DLOG_RING_SIZE - 2);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+    return TEST_SUCCESSFUL;
+}
+
+static char test14_order[16];
+static uint8_t test14_pos;
+static int8_t test14a_task_func (uint8_t event, void *data) {
+    if((event != EV_START) && (test14_pos < sizeof(test14_order) - 1)) {
+        test14_order[test14_pos++] = 'A';
+    }
+    return 1;
+}
+static int8_t test14b_task_func (uint8_t event, void *data) {
+    if((event != EV_START) && (test14_pos < sizeof(test14_order) - 1)) {
+        test14_order[test14_pos++] = 'B';
+    }
+    return 1;
+}
+static task_t test14a_task = {.task = test14a_task_func, .name = "TEST14A_TASK", .group = 1};
+static task_t test14b_task = {.task = test14b_task_func, .name = "TEST14B_TASK"};
+
+int8_t test14(void) {
+    uint8_t test_nr = 1, n;
+    int8_t res, res_should;
+    printf(" + test14: scheduler_ctx_set_task_group(), scheduler_ctx_set_group_weight()\n");
+
+    printf("   %02d: group 1 (weight 1) sends 1st, group 2 (weight 2) is not starved\n", test_nr);
+    res_should = true;
+    res = scheduler_ctx_add_task(&test09_ctx, &test14a_task) &&
+          scheduler_ctx_add_task(&test09_ctx, &test14b_task) &&
+          scheduler_ctx_set_task_group(&test09_ctx, test14b_task.tid, 2) &&
+          scheduler_ctx_set_group_weight(&test09_ctx, 2, 2) &&
+          scheduler_ctx_start_task(&test09_ctx, test14a_task.tid) &&
+          scheduler_ctx_start_task(&test09_ctx, test14b_task.tid);
+    while(scheduler_ctx_run_once(&test09_ctx) == true);
+    test14_pos = 0;
+    for(n = 0; n < 4; n++) {
+        res = res && scheduler_ctx_send_event(&test09_ctx, test14a_task.tid, 1, NULL);
+    }
+    for(n = 0; n < 4; n++) {
+        res = res && scheduler_ctx_send_event(&test09_ctx, test14b_task.tid, 1, NULL);
+    }
+    while(scheduler_ctx_run_once(&test09_ctx) == true);
+    test14_order[test14_pos] = 0;
+    printf("       order: %s\n", test14_order);
+    // 1 A per 2 B, all 4 B are done before the last 2 A (a single fifo: AAAABBBB)
+    res = res && (test14_pos == 8) && (strrchr(test14_order, 'B') - test14_order <= 5);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+
+    test_nr++;
+    printf("   %02d: scheduler_ctx_set_task_group(), task is started or no such group, should fail\n", test_nr);
+    res_should = false;
+    res = scheduler_ctx_set_task_group(&test09_ctx, test14a_task.tid, 0) ||
+          scheduler_ctx_set_group_weight(&test09_ctx, EVENTS_NB_OF_GROUPS, 1) ||
+          scheduler_ctx_set_group_weight(&test09_ctx, 1, 0);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+    return TEST_SUCCESSFUL;
+}
+
+typedef struct {
+    uint16_t id;
+    uint32_t value;
+} test15_item_t;
+CHANNEL_DEFINE(test15_ch, test15_item_t, 4);
+CHANNEL_TYPED(test15_ch, test15_item_t)
+CHANNEL_TYPED(test15_u8, uint8_t)
+static uint16_t test15_sent, test15_received, test15_readable, test15_writable;
+static int8_t test15w_res[CHANNEL_NB_OF_WAITERS + 1];
+static uint8_t test15w_count, test15w_writable;
+static int8_t test15p_task_func (uint8_t event, void *data) {
+    test15_item_t item;
+    if(event == 16) {
+        test15_writable++;
+    }
+    if((event == 1) || (event == 16)) {
+        // send 5 values, as many as fit
+        while(test15_sent < 5) {
+            item.id = test15_sent;
+            item.value = 1000 + test15_sent;
+            if(test15_ch_send(&test15_ch, &item) != true) {
+                break;
+            }
+            test15_sent++;
+        }
+    }
+    return 1;
+}
+static int8_t test15c_task_func (uint8_t event, void *data) {
+    test15_item_t items[8];
+    uint16_t n, k;
+    if(event == 15) {
+        test15_readable++;
+        n = test15_ch_receive(&test15_ch, items, 8);
+        for(k = 0; k < n; k++) {
+            if((items[k].id == test15_received) && (items[k].value == 1000u + test15_received)) {
+                test15_received++;
+            }
+        }
+    }
+    return 1;
+}
+static int8_t test15w_task_func (uint8_t event, void *data) {
+    test15_item_t item = {.id = 0xFFFF};
+    if(event == 2) {
+        test15w_res[test15w_count++] = test15_ch_send(&test15_ch, &item);
+    }
+    if(event == 16) {
+        test15w_writable++;
+    }
+    return 1;
+}
+static task_t test15p_task = {.task = test15p_task_func, .name = "TEST15P_TASK"};
+static task_t test15c_task = {.task = test15c_task_func, .name = "TEST15C_TASK"};
+static task_t test15w_task[CHANNEL_NB_OF_WAITERS + 1];
+
+int8_t test15(void) {
+    uint8_t test_nr = 1;
+    int8_t res, res_should;
+    printf(" + test15: channel_send(), channel_receive()\n");
+
+    if(EVENT_DATA_FITS(&test15_ch) == false) {
+        // EVENTS_COMPACT on a 64 bit host, the events can not carry the channel
+        printf("   %02d: the address of the channel does not fit into the event data, it is refused\n", test_nr);
+        res_should = false;
+        res = CHANNEL_CTX_INIT(&test09_ctx, test15_ch, 1, 15, 16);
+        printf("       should: %s\n", get_bool_string(res_should));
+        printf("       result: %s\n", get_bool_string(res));
+        if(res != res_should) {
+            return TEST_FAILED;
+        }
+        return TEST_SUCCESSFUL;
+    }
+
+
+    printf("   %02d: 5 values through a channel of 4, backpressure, 1 readable event per burst\n", test_nr);
+    res_should = true;
+    res = scheduler_ctx_add_task(&test09_ctx, &test15p_task) &&
+          scheduler_ctx_add_task(&test09_ctx, &test15c_task) &&
+          CHANNEL_CTX_INIT(&test09_ctx, test15_ch, test15c_task.tid, 15, 16) &&
+          scheduler_ctx_start_task(&test09_ctx, test15p_task.tid) &&
+          scheduler_ctx_start_task(&test09_ctx, test15c_task.tid);
+    while(scheduler_ctx_run_once(&test09_ctx) == true);
+    res = res && scheduler_ctx_send_event(&test09_ctx, test15p_task.tid, 1, NULL);
+    while(scheduler_ctx_run_once(&test09_ctx) == true);
+    printf("       sent: %d, received: %d, readable: %d, writable: %d\n",
+        test15_sent, test15_received, test15_readable, test15_writable);
+    res = res && (test15_sent == 5) && (test15_received == 5) && (test15_readable == 2) && (test15_writable == 1) &&
+          (channel_count(&test15_ch) == 0) && (channel_space(&test15_ch) == 4);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+
+    test_nr++;
+    printf("   %02d: typed send and receive refuse a channel of another item_size\n", test_nr);
+    res_should = false;
+    uint8_t u8 = 0;
+    res = test15_u8_send(&test15_ch, &u8) || (test15_u8_receive(&test15_ch, &u8, 1) != 0) || (channel_count(&test15_ch) != 0);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+
+    test_nr++;
+    printf("   %02d: %d senders find the channel full, 1 more than waiter slots, it gets CHANNEL_FULL_NO_WAITER\n",
+        test_nr, CHANNEL_NB_OF_WAITERS + 1);
+    res_should = true;
+    res = true;
+    test15w_count = 0;
+    test15w_writable = 0;
+    for(uint8_t n = 0; n <= CHANNEL_NB_OF_WAITERS; n++) {
+        test15w_task[n].task = test15w_task_func;
+        test15w_task[n].name = "TEST15W_TASK";
+        res = res && scheduler_ctx_add_task(&test09_ctx, &test15w_task[n]) &&
+              scheduler_ctx_start_task(&test09_ctx, test15w_task[n].tid);
+    }
+    while(scheduler_ctx_run_once(&test09_ctx) == true);
+    for(uint8_t n = 0; n <= CHANNEL_NB_OF_WAITERS; n++) {
+        res = res && scheduler_ctx_send_event(&test09_ctx, test15w_task[n].tid, 2, NULL);
+    }
+    // fill the channel before the senders run, not from a task: no waiter
+    while(channel_space(&test15_ch)) {
+        test15_item_t item = {.id = 0xFFFF};
+        res = res && test15_ch_send(&test15_ch, &item);
+    }
+    while(scheduler_ctx_run_once(&test09_ctx) == true);
+    for(uint8_t n = 0; n < CHANNEL_NB_OF_WAITERS; n++) {
+        res = res && (test15w_res[n] == false);
+    }
+    printf("       last: %d, writable: %d\n", test15w_res[CHANNEL_NB_OF_WAITERS], test15w_writable);
+    res = res && (test15w_count == CHANNEL_NB_OF_WAITERS + 1) && (test15w_res[CHANNEL_NB_OF_WAITERS] == CHANNEL_FULL_NO_WAITER) &&
+          (test15w_writable == CHANNEL_NB_OF_WAITERS) && (channel_count(&test15_ch) == 0);
+    for(uint8_t n = 0; n <= CHANNEL_NB_OF_WAITERS; n++) {
+        scheduler_ctx_remove_task(&test09_ctx, &test15w_task[n]);
+    }
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+    return TEST_SUCCESSFUL;
+}
+
+#ifdef SNAPSHOT_ON
+static scheduler_ctx_t test16a_ctx, test16b_ctx;
+static uint16_t test16_count;
+static uintptr_t test16_data;
+static int8_t test16_task_func (uint8_t event, void *data) {
+    if(event == 16) {
+        test16_count++;
+        test16_data += (uintptr_t)data;
+    }
+    return 1;
+}
+static task_t test16a_task = {.task = test16_task_func, .name = "TEST16_TASK"};
+static task_t test16b_task = {.task = test16_task_func, .name = "TEST16_TASK"};
+static task_t test16_other_task = {.task = test16_task_func, .name = "TEST16_OTHER"};
+
+int8_t test16(void) {
+    uint8_t test_nr = 1;
+    int8_t res, res_should;
+    char path[256];
+    printf(" + test16: snapshot_ctx_save(), snapshot_ctx_restore()\n");
+
+    printf("   %02d: save 2 events and 1 timer event, restore into another instance, other tid, the timer event is still pending\n", test_nr);
+    res_should = true;
+    test16_count = 0;
+    test16_data = 0;
+    unlink(test_tmp_path(path, sizeof(path), "test16.snapshot"));
+    scheduler_ctx_init(&test16a_ctx);
+    scheduler_ctx_start_event_timer(&test16a_ctx);
+    res = scheduler_ctx_add_task(&test16a_ctx, &test16a_task) &&
+          scheduler_ctx_start_task(&test16a_ctx, test16a_task.tid);
+    while(scheduler_ctx_run_once(&test16a_ctx) == true);
+    res = res && scheduler_ctx_send_event(&test16a_ctx, test16a_task.tid, 16, (void *)1) &&
+          scheduler_ctx_send_event(&test16a_ctx, test16a_task.tid, 16, (void *)2) &&
+          scheduler_ctx_add_timer_event(&test16a_ctx, 10000, test16a_task.tid, 16, (void *)4) &&
+          snapshot_ctx_open(&test16a_ctx, path) &&
+          snapshot_ctx_save(&test16a_ctx);
+    snapshot_ctx_close(&test16a_ctx);
+    // "restart"
+    scheduler_ctx_init(&test16b_ctx);
+    scheduler_ctx_start_event_timer(&test16b_ctx);
+    res = res && scheduler_ctx_add_task(&test16b_ctx, &test16_other_task) &&
+          scheduler_ctx_add_task(&test16b_ctx, &test16b_task) &&
+          (test16b_task.tid != test16a_task.tid) &&
+          snapshot_ctx_open(&test16b_ctx, path) &&
+          (snapshot_ctx_restore(&test16b_ctx) == 3) &&
+          (snapshot_ctx_restore(&test16b_ctx) == 0);
+    snapshot_ctx_close(&test16b_ctx);
+    unlink(path);
+    while(scheduler_ctx_run_once(&test16b_ctx) == true);
+    printf("       count: %d, data: %d\n", test16_count, (int)test16_data);
+    // the restore subtracts the real time since the save, far less than 10000 ticks
+    res = res && (test16b_task.state != TASK_STATE_NONE) && (test16_count == 2) && (test16_data == 3) &&
+          (scheduler_ctx_cancel_timer_events(&test16b_ctx, test16b_task.tid, 16) == 1);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+    return TEST_SUCCESSFUL;
+}
+#endif // SNAPSHOT_ON
+
+static int8_t test17_task_func (uint8_t event, void *data) {
+    return 1;
+}
+static task_t test17_task = {.task = test17_task_func, .name = "TEST17_TASK"};
+
+static scheduler_ctx_t test17b_ctx;
+static void test17_timer_isr(int sig) {
+    (void)sig;
+#ifndef EV_TIMER_HOST_CLOCK
+    events_ctx_timer_tick(&test17b_ctx.events, 10);
+#endif
+}
+static int8_t test17b_task_func (uint8_t event, void *data) {
+    if(event == 17) {
+        // the main_fifo of this instance is empty
+        power_mode_sleep();
+    }
+    return 1;
+}
+static task_t test17b_task = {.task = test17b_task_func, .name = "TEST17B_TASK"};
+
+int8_t test17(void) {
+    uint8_t test_nr = 1;
+    int8_t res, res_should;
+    power_mode_stats_t stats;
+    event_t next;
+    printf(" + test17: power_mode_get_stats()\n");
+
+    printf("   %02d: power_mode_sleep() with a pending event, 1 entry, the 1st event is the wakeup cause\n", test_nr);
+    res_should = true;
+    power_mode_reset_stats();
+    res = scheduler_add_task(&test17_task) &&
+          scheduler_send_event(test17_task.tid, 17, NULL) &&
+          events_peek_main_fifo(&next);
+    power_mode_sleep();
+    power_mode_get_stats(&stats);
+    printf("       entries: %d, wakeups: %d, cause: tid %d, event %d, count %d\n",
+        stats.mode[POWER_MODE_2].entries, stats.mode[POWER_MODE_2].wakeups,
+        stats.cause[0].tid, stats.cause[0].event, stats.cause[0].count);
+    res = res && (stats.mode[POWER_MODE_2].entries == 1) && (stats.mode[POWER_MODE_2].wakeups == 0) &&
+          (stats.cause[0].tid == next.tid) && (stats.cause[0].event == next.event) &&
+          (stats.cause[0].count == 1) && (stats.cause[1].count == 0);
+    events_purge_main_fifo(test17_task.tid);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+
+    test_nr++;
+    printf("   %02d: power_mode_sleep() until a timer event is due in 10 ticks, residency and wakeup cause\n", test_nr);
+    res_should = true;
+    power_mode_reset_stats();
+    scheduler_ctx_init(&test17b_ctx);
+    scheduler_ctx_start_event_timer(&test17b_ctx);
+    res = scheduler_ctx_add_task(&test17b_ctx, &test17b_task) &&
+          scheduler_ctx_start_task(&test17b_ctx, test17b_task.tid);
+    while(scheduler_ctx_run_once(&test17b_ctx) == true);
+    power_mode_reset_stats();
+    res = res && scheduler_ctx_add_timer_event(&test17b_ctx, 10, test17b_task.tid, 18, NULL) &&
+          scheduler_ctx_send_event(&test17b_ctx, test17b_task.tid, 17, NULL);
+    // the "timer interrupt" comes during the sleep
+    signal(SIGALRM, test17_timer_isr);
+    setitimer(ITIMER_REAL, &(struct itimerval){.it_value = {.tv_usec = 10000}}, NULL);
+    scheduler_ctx_run_once(&test17b_ctx);
+    // with the host clock the sleep can end before the alarm, disarm it first
+    setitimer(ITIMER_REAL, &(struct itimerval){0}, NULL);
+    signal(SIGALRM, SIG_DFL);
+    power_mode_get_stats(&stats);
+    printf("       time: %d us, wakeups: %d, cause: tid %d, event %d, flags %d\n",
+        (int)(stats.mode[POWER_MODE_2].time_ns / 1000), stats.mode[POWER_MODE_2].wakeups,
+        stats.cause[0].tid, stats.cause[0].event, stats.cause[0].flags);
+    res = res && (stats.mode[POWER_MODE_2].entries == 1) && (stats.mode[POWER_MODE_2].wakeups >= 1) &&
+          (stats.mode[POWER_MODE_2].time_ns >= events_ticks_to_ns(5)) &&
+          (stats.cause[0].tid == test17b_task.tid) && (stats.cause[0].event == 18) &&
+          (stats.cause[0].flags == POWER_MODE_WAKE_TIMER) && (stats.cause[0].count == 1);
+    scheduler_remove_task(&test17_task);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+    return TEST_SUCCESSFUL;
+}
+
+#ifdef EVENTS_LATENCY_ON
+int8_t test18(void) {
+    uint8_t test_nr = 1, n;
+    int8_t res, res_should;
+    uint32_t p50, p99, p999;
+    printf(" + test18: scheduler_ctx_get_task_latency()\n");
+
+    printf("   %02d: 10 events, 10 samples of queueing delay and runtime, p50 <= p99 <= p999\n", test_nr);
+    res_should = true;
+    res = scheduler_ctx_reset_task_latency(&test09_ctx, test09_task.tid);
+    for(n = 0; n < 10; n++) {
+        res = res && scheduler_ctx_send_event(&test09_ctx, test09_task.tid, 18, NULL);
+    }
+    while(scheduler_ctx_run_once(&test09_ctx) == true);
+    p50 = scheduler_ctx_get_task_latency(&test09_ctx, test09_task.tid, SCHEDULER_LATENCY_QUEUE, 500);
+    p99 = scheduler_ctx_get_task_latency(&test09_ctx, test09_task.tid, SCHEDULER_LATENCY_QUEUE, 990);
+    p999 = scheduler_ctx_get_task_latency(&test09_ctx, test09_task.tid, SCHEDULER_LATENCY_QUEUE, 999);
+    printf("       queue p50: %u, p99: %u, p999: %u ns\n", p50, p99, p999);
+    res = res && (test09_task.queue_delay.count == 10) && (test09_task.exec_time.count == 10) &&
+          (p50 != 0) && (p50 <= p99) && (p99 <= p999) &&
+          (scheduler_ctx_get_task_latency(&test09_ctx, test09_task.tid, SCHEDULER_LATENCY_EXEC, 999) != 0) &&
+          (scheduler_ctx_get_task_latency(&test09_ctx, 200, SCHEDULER_LATENCY_EXEC, 999) == 0);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+    return TEST_SUCCESSFUL;
+}
+#endif // EVENTS_LATENCY_ON
+
+#ifdef REPLAY_ON
+static scheduler_ctx_t test19a_ctx, test19b_ctx;
+static uint16_t test19_count;
+static uintptr_t test19_data;
+static uint8_t test19_tid;
+static int8_t test19_task_func (uint8_t event, void *data) {
+    if(event == 19) {
+        // an input from the task, replays by itself
+        scheduler_send_event(test19_tid, 20, data);
+    }
+    if(event == 20) {
+        test19_count++;
+        test19_data += (uintptr_t)data;
+    }
+    return 1;
+}
+static task_t test19a_task = {.task = test19_task_func, .name = "TEST19_TASK"};
+static task_t test19b_task = {.task = test19_task_func, .name = "TEST19_TASK"};
+
+int8_t test19(void) {
+    uint8_t test_nr = 1;
+    int8_t res, res_should;
+    uint16_t count;
+    uintptr_t data;
+    uint64_t ticks;
+    replay_stats_t st;
+    char path[256];
+    printf(" + test19: replay_ctx_record_start(), replay_ctx_run()\n");
+
+    printf("   %02d: record 2 events, 1 timer event and 1 from an ISR, replay into another instance\n", test_nr);
+    res_should = true;
+    test19_count = 0;
+    test19_data = 0;
+    scheduler_ctx_init(&test19a_ctx);
+    scheduler_ctx_start_event_timer(&test19a_ctx);
+    res = scheduler_ctx_add_task(&test19a_ctx, &test19a_task) &&
+          scheduler_ctx_start_task(&test19a_ctx, test19a_task.tid) &&
+          ((test19_tid = test19a_task.tid) != 0) &&
+          replay_ctx_record_start(&test19a_ctx, test_tmp_path(path, sizeof(path), "test19.replay"));
+    ticks = events_ctx_get_time_ticks(&test19a_ctx.events);
+    res = res && scheduler_ctx_send_event(&test19a_ctx, test19a_task.tid, 19, (void *)1);
+    while(scheduler_ctx_run_once(&test19a_ctx) == true);
+    test_timer_advance(&test19a_ctx.events, 3);
+    while(scheduler_ctx_run_once(&test19a_ctx) == true);
+    res = res && scheduler_ctx_send_event(&test19a_ctx, test19a_task.tid, 19, (void *)2) &&
+          scheduler_ctx_add_timer_event(&test19a_ctx, 5, test19a_task.tid, 19, (void *)4) &&
+          scheduler_ctx_add_timer_event_from_isr(&test19a_ctx, 2, test19a_task.tid, 19, (void *)8);
+    test_timer_advance(&test19a_ctx.events, 5);
+    while(scheduler_ctx_run_once(&test19a_ctx) == true);
+    ticks = events_ctx_get_time_ticks(&test19a_ctx.events) - ticks;
+    replay_ctx_record_stop(&test19a_ctx);
+    count = test19_count;
+    data = test19_data;
+
+    test19_count = 0;
+    test19_data = 0;
+    scheduler_ctx_init(&test19b_ctx);
+    scheduler_ctx_start_event_timer(&test19b_ctx);
+    res = res && scheduler_ctx_add_task(&test19b_ctx, &test19b_task) &&
+          scheduler_ctx_start_task(&test19b_ctx, test19b_task.tid) &&
+          (test19b_task.tid == test19a_task.tid) &&
+          replay_ctx_run(&test19b_ctx, path, &st);
+    unlink(path);
+    printf("       count: %d, data: %d, records: %d, ticks: %d\n", test19_count, (int)test19_data, st.records, (int)st.ticks);
+    res = res && (count == 4) && (data == 15) && (test19_count == count) && (test19_data == data) &&
+          (st.records == 4) && (st.ticks == ticks) &&
+          (replay_ctx_run(&test19b_ctx, "test19.none", NULL) == false);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+    return TEST_SUCCESSFUL;
+}
+#endif // REPLAY_ON
+
+static scheduler_ctx_t test20_ctx;
+static task_t test20_task;
+static uint8_t test20_events, test20_slices, test20_tid_ok, test20_yield_ok;
+static int8_t test20_task_func (uint8_t event, void *data) {
+    if(event == 20) {
+        test20_events++;
+    }
+    if(event == EV_IDLE) {
+        test20_slices++;
+        // an idle slice runs as its task, the budget of 0 is used up at once
+        test20_tid_ok += (scheduler_ctx_get_current_tid(&test20_ctx) == test20_task.tid);
+        test20_yield_ok += (scheduler_ctx_idle_should_yield(&test20_ctx) == true);
+        // done after 3 slices
+        return (test20_slices < 3);
+    }
+    return 1;
+}
+static task_t test20_task = {.task = test20_task_func, .name = "TEST20_TASK"};
+static task_t test20b_task;
+static uint8_t test20b_tid, test20b_yield_before, test20b_yield_staged;
+static int8_t test20b_task_func (uint8_t event, void *data) {
+    if(event == EV_IDLE) {
+        // only an idle task, it got a tid anyway
+        test20b_tid = scheduler_ctx_get_current_tid(&test20_ctx);
+        test20b_yield_before = scheduler_ctx_idle_should_yield(&test20_ctx);
+        // a timer request from an ISR has priority as well
+        scheduler_ctx_add_timer_event_from_isr(&test20_ctx, 10000, test20b_tid, 20, NULL);
+        test20b_yield_staged = scheduler_ctx_idle_should_yield(&test20_ctx);
+        return 0;
+    }
+    return 1;
+}
+static task_t test20b_task = {.task = test20b_task_func, .name = "TEST20B_TASK"};
+
+int8_t test20(void) {
+    uint8_t test_nr = 1;
+    int8_t res, res_should;
+    printf(" + test20: scheduler_ctx_add_idle_task(), scheduler_ctx_idle_should_yield()\n");
+
+    printf("   %02d: events first, then 3 idle slices until the idle task is done\n", test_nr);
+    res_should = true;
+    scheduler_ctx_init(&test20_ctx);
+    scheduler_ctx_start_event_timer(&test20_ctx);
+    res = scheduler_ctx_add_task(&test20_ctx, &test20_task) &&
+          scheduler_ctx_start_task(&test20_ctx, test20_task.tid);
+    while(scheduler_ctx_run_once(&test20_ctx) == true);
+    scheduler_ctx_set_idle_budget(&test20_ctx, 0);
+    res = res && scheduler_ctx_add_idle_task(&test20_ctx, &test20_task) &&
+          scheduler_ctx_send_event(&test20_ctx, test20_task.tid, 20, NULL) &&
+          scheduler_ctx_run_once(&test20_ctx) && (test20_events == 1) && (test20_slices == 0) &&
+          scheduler_ctx_run_once(&test20_ctx) && scheduler_ctx_run_once(&test20_ctx) &&
+          scheduler_ctx_run_once(&test20_ctx) && (scheduler_ctx_run_once(&test20_ctx) == false);
+    printf("       events: %d, slices: %d, as its task: %d, should yield: %d\n",
+        test20_events, test20_slices, test20_tid_ok, test20_yield_ok);
+    res = res && (test20_slices == 3) && (test20_tid_ok == 3) && (test20_yield_ok == 3) &&
+          (scheduler_ctx_get_current_tid(&test20_ctx) == 0) && (scheduler_ctx_should_yield(&test20_ctx) == false);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+
+    test_nr++;
+    printf("   %02d: an idle task only gets a tid for its work, staged ISR timer requests make it yield\n", test_nr);
+    res_should = true;
+    scheduler_ctx_init(&test20_ctx);
+    scheduler_ctx_start_event_timer(&test20_ctx);
+    while(scheduler_ctx_run_once(&test20_ctx) == true);
+    scheduler_ctx_set_idle_budget(&test20_ctx, 1000000000);
+    test20b_task.tid = 0;
+    res = scheduler_ctx_add_idle_task(&test20_ctx, &test20b_task) && (test20b_task.tid != 0) &&
+          scheduler_ctx_run_once(&test20_ctx);
+    printf("       tid: %d, should yield: %d/%d\n", test20b_tid, test20b_yield_before, test20b_yield_staged);
+    res = res && (test20b_tid == test20b_task.tid) && (test20b_yield_before == false) && (test20b_yield_staged == true) &&
+          // done, it is not in the task list anymore
+          (scheduler_ctx_remove_task(&test20_ctx, &test20b_task) == false);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+    return TEST_SUCCESSFUL;
+}
+
+static scheduler_ctx_t test21_ctx;
+static uint16_t test21_calls, test21_count;
+static uintptr_t test21_data;
+static int8_t test21_task_func (uint8_t event, void *data) {
+    if((event >= 21) && (event <= 23)) {
+        test21_calls++;
+        test21_count += scheduler_ctx_get_event_count(&test21_ctx);
+        test21_data = (uintptr_t)data;
+    }
+    return 1;
+}
+static task_t test21_task = {.task = test21_task_func, .name = "TEST21_TASK"};
+
+int8_t test21(void) {
+    uint8_t test_nr = 1;
+    int8_t res, res_should;
+    printf(" + test21: scheduler_ctx_send_event_coalesced(), scheduler_ctx_set_event_coalescing()\n");
+
+    printf("   %02d: 3 coalesced sends, 1 call with the last data and count 3, the next send is pending again\n", test_nr);
+    res_should = true;
+    scheduler_ctx_init(&test21_ctx);
+    res = scheduler_ctx_add_task(&test21_ctx, &test21_task) &&
+          scheduler_ctx_start_task(&test21_ctx, test21_task.tid);
+    while(scheduler_ctx_run_once(&test21_ctx) == true);
+    test21_calls = 0;
+    test21_count = 0;
+    res = res && scheduler_ctx_send_event_coalesced(&test21_ctx, test21_task.tid, 21, (void *)1) &&
+          scheduler_ctx_send_event_coalesced(&test21_ctx, test21_task.tid, 21, (void *)2) &&
+          scheduler_ctx_send_event_coalesced(&test21_ctx, test21_task.tid, 21, (void *)3);
+    while(scheduler_ctx_run_once(&test21_ctx) == true);
+    printf("       calls: %d, count: %d, data: %d\n", test21_calls, test21_count, (int)test21_data);
+    res = res && (test21_calls == 1) && (test21_count == 3) && (test21_data == 3);
+    res = res && scheduler_ctx_send_event_coalesced(&test21_ctx, test21_task.tid, 21, (void *)4);
+    while(scheduler_ctx_run_once(&test21_ctx) == true);
+    res = res && (test21_calls == 2) && (test21_count == 4) && (test21_data == 4);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+
+    test_nr++;
+    printf("   %02d: always coalesce event 22, not event 23\n", test_nr);
+    res_should = true;
+    test21_calls = 0;
+    test21_count = 0;
+    res = scheduler_ctx_set_event_coalescing(&test21_ctx, 22, true) &&
+          scheduler_ctx_send_event(&test21_ctx, test21_task.tid, 22, (void *)5) &&
+          scheduler_ctx_send_event(&test21_ctx, test21_task.tid, 22, (void *)6) &&
+          scheduler_ctx_send_event(&test21_ctx, test21_task.tid, 23, (void *)7) &&
+          scheduler_ctx_send_event(&test21_ctx, test21_task.tid, 23, (void *)8);
+    while(scheduler_ctx_run_once(&test21_ctx) == true);
+    printf("       calls: %d, count: %d, data: %d\n", test21_calls, test21_count, (int)test21_data);
+    res = res && (test21_calls == 3) && (test21_count == 4) && (test21_data == 8);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+    return TEST_SUCCESSFUL;
+}
+
+static scheduler_ctx_t test22_ctx;
+static uint8_t test22_yield_before, test22_yield_after, test22_hook_calls;
+static uint32_t test22_hook_runtime;
+static void test22_overrun_hook(task_t *p, uint8_t event, uint32_t runtime_ns) {
+    test22_hook_calls++;
+    test22_hook_runtime = runtime_ns;
+}
+static int8_t test22_task_func (uint8_t event, void *data) {
+    if(event == 22) {
+        test22_yield_before = scheduler_ctx_should_yield(&test22_ctx);
+        // the timer interrupt ticks while the task runs
+        test_timer_advance(&test22_ctx.events, 2);
+        test22_yield_after = scheduler_ctx_should_yield(&test22_ctx);
+    }
+    return 1;
+}
+static task_t test22_task = {.task = test22_task_func, .name = "TEST22_TASK"};
+
+int8_t test22(void) {
+    uint8_t test_nr = 1;
+    int8_t res, res_should;
+    printf(" + test22: scheduler_ctx_set_task_budget(), scheduler_ctx_should_yield(), overruns\n");
+
+    printf("   %02d: budget of 1 tick, the task runs 2 ticks: should_yield, 1 overrun, hook called\n", test_nr);
+    res_should = true;
+    test22_hook_calls = 0;
+    scheduler_ctx_init(&test22_ctx);
+    scheduler_ctx_start_event_timer(&test22_ctx);
+    scheduler_ctx_set_overrun_hook(&test22_ctx, test22_overrun_hook);
+    res = scheduler_ctx_add_task(&test22_ctx, &test22_task) &&
+          scheduler_ctx_start_task(&test22_ctx, test22_task.tid) &&
+          scheduler_ctx_set_task_budget(&test22_ctx, test22_task.tid, (uint32_t)events_ticks_to_ns(1));
+    while(scheduler_ctx_run_once(&test22_ctx) == true);
+    res = res && (test22_task.overruns == 0) &&
+          scheduler_ctx_send_event(&test22_ctx, test22_task.tid, 22, NULL);
+    while(scheduler_ctx_run_once(&test22_ctx) == true);
+    printf("       yield before: %d, after: %d, overruns: %d, hook: %d, runtime max: %u us\n",
+        test22_yield_before, test22_yield_after, test22_task.overruns, test22_hook_calls, test22_task.runtime_max_ns / 1000);
+    res = res && (test22_yield_before == false) && (test22_yield_after == true) &&
+          (test22_task.overruns == 1) && (test22_hook_calls == 1) &&
+          (test22_task.runtime_max_ns >= events_ticks_to_ns(2)) && (test22_hook_runtime == test22_task.runtime_max_ns) &&
+          (scheduler_ctx_should_yield(&test22_ctx) == false);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+    return TEST_SUCCESSFUL;
+}
+
+static scheduler_ctx_t test23_ctx;
+static uint8_t test23_count;
+static uintptr_t test23_order;
+static int8_t test23_task_func (uint8_t event, void *data) {
+    if(event == 23) {
+        test23_count++;
+        test23_order = test23_order * 10 + (uintptr_t)data;
+    }
+    return 1;
+}
+static task_t test23_task = {.task = test23_task_func, .name = "TEST23_TASK"};
+
+int8_t test23(void) {
+    uint8_t test_nr = 1;
+    int8_t res, res_should;
+    events_timer_stats_t stats;
+    printf(" + test23: late ticks, events_ctx_get_timer_stats()\n");
+
+    printf("   %02d: 3 timer events due in 1, 2, 3 ticks, 5 ticks at once: all expire in order, lateness\n", test_nr);
+    res_should = true;
+    test23_count = 0;
+    test23_order = 0;
+    scheduler_ctx_init(&test23_ctx);
+    scheduler_ctx_start_event_timer(&test23_ctx);
+    res = scheduler_ctx_add_task(&test23_ctx, &test23_task) &&
+          scheduler_ctx_start_task(&test23_ctx, test23_task.tid);
+    while(scheduler_ctx_run_once(&test23_ctx) == true);
+    events_ctx_reset_timer_stats(&test23_ctx.events);
+    res = res && scheduler_ctx_add_timer_event(&test23_ctx, 3, test23_task.tid, 23, (void *)3) &&
+          scheduler_ctx_add_timer_event(&test23_ctx, 1, test23_task.tid, 23, (void *)1) &&
+          scheduler_ctx_add_timer_event(&test23_ctx, 2, test23_task.tid, 23, (void *)2);
+    test_timer_advance(&test23_ctx.events, 5);
+    while(scheduler_ctx_run_once(&test23_ctx) == true);
+    res = res && events_ctx_get_timer_stats(&test23_ctx.events, &stats);
+    printf("       count: %d, order: %d, expired: %u, late: %u, lateness max: %llu, sum: %llu\n",
+        test23_count, (int)test23_order, stats.expired, stats.late,
+        (unsigned long long)stats.lateness_max, (unsigned long long)stats.lateness_sum);
+    // with the host clock the ticks come a little later, never earlier
+    res = res && (test23_count == 3) && (test23_order == 123) && (stats.expired == 3) && (stats.late == 3) &&
+          (stats.lateness_max >= 4) && (stats.lateness_sum >= (4 + 3 + 2));
+#ifndef EV_TIMER_HOST_CLOCK
+    res = res && (stats.lateness_max == 4) && (stats.lateness_sum == (4 + 3 + 2));
+#endif
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+    return TEST_SUCCESSFUL;
+}
+
+static scheduler_ctx_t test24_ctx;
+static uintptr_t test24_data;
+static int8_t test24_task_func (uint8_t event, void *data) {
+    if(event == 24) {
+        test24_data += (uintptr_t)data;
+    }
+    return 1;
+}
+static task_t test24_task = {.task = test24_task_func, .name = "TEST24_TASK"};
+
+int8_t test24(void) {
+    uint8_t test_nr = 1;
+    int8_t res, res_should;
+    uint64_t now;
+    printf(" + test24: scheduler_ctx_add_timer_event_at(), 64 bit time in ticks\n");
+
+    printf("   %02d: deadline now + 3 ticks, not due after 2 ticks, due after 3\n", test_nr);
+    res_should = true;
+    test24_data = 0;
+    scheduler_ctx_init(&test24_ctx);
+    scheduler_ctx_start_event_timer(&test24_ctx);
+    res = scheduler_ctx_add_task(&test24_ctx, &test24_task) &&
+          scheduler_ctx_start_task(&test24_ctx, test24_task.tid);
+    while(scheduler_ctx_run_once(&test24_ctx) == true);
+    now = scheduler_ctx_get_time_ticks(&test24_ctx);
+    res = res && scheduler_ctx_add_timer_event_at(&test24_ctx, now + 3, test24_task.tid, 24, (void *)1);
+    test_timer_advance(&test24_ctx.events, 2);
+    while(scheduler_ctx_run_once(&test24_ctx) == true);
+    res = res && ((TEST_TICKS_EXACT == false) || (test24_data == 0));
+    test_timer_advance(&test24_ctx.events, 1);
+    while(scheduler_ctx_run_once(&test24_ctx) == true);
+    res = res && (test24_data == 1);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+
+#ifndef EV_TIMER_HOST_CLOCK
+    test_nr++;
+    printf("   %02d: past 2^32 ticks, deadlines and timeouts still in order, a past deadline is due at once\n", test_nr);
+    res_should = true;
+    test24_data = 0;
+    test_timer_advance(&test24_ctx.events, 0xFFFFFFFF);
+    while(scheduler_ctx_run_once(&test24_ctx) == true);
+    now = scheduler_ctx_get_time_ticks(&test24_ctx);
+    res = (now > 0xFFFFFFFFull) &&
+          scheduler_ctx_add_timer_event_at(&test24_ctx, now + 2, test24_task.tid, 24, (void *)1) &&
+          scheduler_ctx_add_timer_event(&test24_ctx, 1, test24_task.tid, 24, (void *)2);
+    test_timer_advance(&test24_ctx.events, 1);
+    while(scheduler_ctx_run_once(&test24_ctx) == true);
+    res = res && (test24_data == 2);
+    test_timer_advance(&test24_ctx.events, 1);
+    while(scheduler_ctx_run_once(&test24_ctx) == true);
+    res = res && (test24_data == 3) &&
+          scheduler_ctx_add_timer_event_at(&test24_ctx, now - 5, test24_task.tid, 24, (void *)4);
+    while(scheduler_ctx_run_once(&test24_ctx) == true);
+    printf("       time: %llu ticks, data: %d\n", (unsigned long long)scheduler_ctx_get_time_ticks(&test24_ctx), (int)test24_data);
+    res = res && (test24_data == 7);
+    printf("       should: %s\n", get_bool_string(res_should));
+    printf("       result: %s\n", get_bool_string(res));
+    if(res != res_should) {
+        return TEST_FAILED;
+    }
+#endif
+    return TEST_SUCCESSFUL;
+}
+
 int main(void) {
     printf("testing scheduler functions\n\n");
 
     test_eval_result(test01());
     test_eval_result(test02());
+    test_eval_result(test07());
+    test_eval_result(test08());
+    test_eval_result(test09());
+    test_eval_result(test10());
+    test_eval_result(test11());
+    test_eval_result(test12());
+    test_eval_result(test13());
+    test_eval_result(test14());
+    test_eval_result(test15());
+#ifdef SNAPSHOT_ON
+    test_eval_result(test16());
+#endif
+    test_eval_result(test17());
+#ifdef EVENTS_LATENCY_ON
+    test_eval_result(test18());
+#endif
+#if defined(REPLAY_ON) && !defined(EV_TIMER_HOST_CLOCK)
+    test_eval_result(test19());
+#endif
+    test_eval_result(test20());
+    test_eval_result(test21());
+    test_eval_result(test22());
+    test_eval_result(test23());
+    test_eval_result(test24());
     test_run_count = 10;
     test_eval_result(test03()); // run()
     // stuck here at the moment, does not leave scheduler_run()